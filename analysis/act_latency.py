@@ -237,6 +237,18 @@ def open_log_file():
         file_id.seek(0, 0)
     elif line.split(" ")[1].startswith("y"):
         Hist.scale_label = " %>(us)"
+    else:
+        # Older ACT versions don't echo nanosecond-histograms.
+        scale_pos = file_id.tell()
+        line = file_id.readline()
+
+        while line and not line.startswith("nanosecond-histograms"):
+            line = file_id.readline()
+
+        if line and line.split(" ")[1].startswith("y"):
+            Hist.scale_label = " %>(ns)"
+
+        file_id.seek(scale_pos, 0)
 
     # Adjust the slice time if necessary:
     Hist.slice_time = ((Args.slice + interval - 1) // interval) * interval
@@ -17,11 +17,13 @@ Group: Applications
 Tools for use with the Aerospike database
 %files
 %defattr(-,aerospike,aerospike)
+/opt/aerospike/bin/act_histlog
 /opt/aerospike/bin/act_index
 /opt/aerospike/bin/act_prep
 /opt/aerospike/bin/act_storage
 /opt/aerospike/bin/act_latency.py
 %defattr(-,root,root)
+/usr/bin/act_histlog
 /usr/bin/act_index
 /usr/bin/act_prep
 /usr/bin/act_storage
@@ -32,6 +34,7 @@ Tools for use with the Aerospike database
 /etc/aerospike/act_index.conf
 
 %prep
+ln -sf /opt/aerospike/bin/act_histlog %{buildroot}/usr/bin/act_histlog
 ln -sf /opt/aerospike/bin/act_index %{buildroot}/usr/bin/act_index
 ln -sf /opt/aerospike/bin/act_prep %{buildroot}/usr/bin/act_prep
 ln -sf /opt/aerospike/bin/act_storage %{buildroot}/usr/bin/act_storage
@@ -0,0 +1,610 @@
+/*
+ * async_io.c
+ *
+ * Copyright (c) 2020 Aerospike, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "async_io.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <linux/aio_abi.h>
+
+#include "clock.h"
+#include "trace.h"
+
+// Older distributions' kernel headers may not have io_uring at all.
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+
+#if defined(IORING_FEAT_EXT_ARG) && defined(__NR_io_uring_setup)
+#define HAS_URING 1
+#endif
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+typedef struct uring_s {
+	int fd;
+	uint32_t n_unsubmitted;
+	uint32_t* sq_tail;
+	uint32_t* sq_mask;
+	uint32_t* sq_array;
+	uint32_t* cq_head;
+	uint32_t* cq_tail;
+	uint32_t* cq_mask;
+	struct io_uring_sqe* sqes;
+	struct io_uring_cqe* cqes;
+	void* sq_ptr;
+	size_t sq_sz;
+	void* cq_ptr;
+	size_t cq_sz;
+	size_t sqes_sz;
+} uring;
+
+typedef struct kaio_s {
+	aio_context_t ctx;
+	struct iocb* iocbs;
+	struct iocb** free_iocbs;
+	uint32_t n_free;
+	struct io_event* events;
+} kaio;
+
+struct async_io_s {
+	io_engine engine;
+	uint32_t depth;
+	uint32_t n_in_flight;
+	kaio kaio;
+#ifdef HAS_URING
+	uring ring;
+#endif
+};
+
+static const char* const ENGINE_NAMES[] = {
+		[IO_ENGINE_SYNC] = "sync",
+		[IO_ENGINE_URING] = "io_uring",
+		[IO_ENGINE_AIO] = "aio"
+};
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static bool kaio_create(kaio* k, uint32_t depth);
+static void kaio_destroy(kaio* k);
+static bool kaio_submit(kaio* k, io_op* op);
+static uint32_t kaio_reap(kaio* k, io_op** ops, uint32_t max_ops,
+		uint64_t timeout_us);
+
+#ifdef HAS_URING
+static bool uring_create(uring* r, uint32_t depth);
+static void uring_destroy(uring* r);
+static bool uring_submit(uring* r, io_op* op);
+static uint32_t uring_reap(uring* r, io_op** ops, uint32_t max_ops,
+		uint64_t timeout_us);
+#endif
+
+
+//==========================================================
+// Public API.
+//
+
+io_engine
+io_engine_from_name(const char* name)
+{
+	for (io_engine e = 0; e < IO_ENGINE_INVALID; e++) {
+		if (strcmp(name, ENGINE_NAMES[e]) == 0) {
+			return e;
+		}
+	}
+
+	return IO_ENGINE_INVALID;
+}
+
+const char*
+io_engine_name(io_engine engine)
+{
+	return engine < IO_ENGINE_INVALID ? ENGINE_NAMES[engine] : "invalid";
+}
+
+//------------------------------------------------
+// Create a per-thread context which can have up
+// to 'depth' operations in flight. Not for use
+// by more than one thread.
+//
+async_io*
+async_io_create(io_engine engine, uint32_t depth)
+{
+	async_io* aio = calloc(1, sizeof(async_io));
+
+	if (aio == NULL) {
+		printf("ERROR: creating async io context (calloc)\n");
+		return NULL;
+	}
+
+	aio->engine = engine;
+	aio->depth = depth;
+
+	switch (engine) {
+	case IO_ENGINE_AIO:
+		if (! kaio_create(&aio->kaio, depth)) {
+			free(aio);
+			return NULL;
+		}
+		break;
+#ifdef HAS_URING
+	case IO_ENGINE_URING:
+		if (! uring_create(&aio->ring, depth)) {
+			free(aio);
+			return NULL;
+		}
+		break;
+#endif
+	default:
+		printf("ERROR: io engine %s not available\n", io_engine_name(engine));
+		free(aio);
+		return NULL;
+	}
+
+	return aio;
+}
+
+//------------------------------------------------
+// Destroy a context. Caller should first reap all
+// operations in flight.
+//
+void
+async_io_destroy(async_io* aio)
+{
+	switch (aio->engine) {
+	case IO_ENGINE_AIO:
+		kaio_destroy(&aio->kaio);
+		break;
+#ifdef HAS_URING
+	case IO_ENGINE_URING:
+		uring_destroy(&aio->ring);
+		break;
+#endif
+	default:
+		break;
+	}
+
+	free(aio);
+}
+
+uint32_t
+async_io_in_flight(const async_io* aio)
+{
+	return aio->n_in_flight;
+}
+
+//------------------------------------------------
+// Start an operation. The op's start time is set
+// here, just before handing it to the kernel.
+//
+bool
+async_io_submit(async_io* aio, io_op* op)
+{
+	if (aio->n_in_flight == aio->depth) {
+		printf("ERROR: async io submit - queue depth %u exceeded\n",
+				aio->depth);
+		return false;
+	}
+
+	op->res = 0;
+	op->start_ns = get_ns();
+
+	bool ok = false;
+
+	switch (aio->engine) {
+	case IO_ENGINE_AIO:
+		ok = kaio_submit(&aio->kaio, op);
+		break;
+#ifdef HAS_URING
+	case IO_ENGINE_URING:
+		ok = uring_submit(&aio->ring, op);
+		break;
+#endif
+	default:
+		break;
+	}
+
+	if (ok) {
+		aio->n_in_flight++;
+	}
+
+	return ok;
+}
+
+//------------------------------------------------
+// Collect completed operations, waiting up to
+// timeout_us for at least one if none are ready.
+// Returns number of ops placed in ops[]. If
+// nothing is in flight, just sleeps out timeout.
+//
+uint32_t
+async_io_reap(async_io* aio, io_op** ops, uint32_t max_ops,
+		uint64_t timeout_us)
+{
+	if (aio->n_in_flight == 0) {
+		if (timeout_us != 0) {
+			usleep((uint32_t)timeout_us);
+		}
+
+		return 0;
+	}
+
+	uint32_t n_ops = 0;
+
+	switch (aio->engine) {
+	case IO_ENGINE_AIO:
+		n_ops = kaio_reap(&aio->kaio, ops, max_ops, timeout_us);
+		break;
+#ifdef HAS_URING
+	case IO_ENGINE_URING:
+		n_ops = uring_reap(&aio->ring, ops, max_ops, timeout_us);
+		break;
+#endif
+	default:
+		break;
+	}
+
+	aio->n_in_flight -= n_ops;
+
+	return n_ops;
+}
+
+
+//==========================================================
+// Local helpers - Linux native aio, via raw syscalls.
+//
+
+static bool
+kaio_create(kaio* k, uint32_t depth)
+{
+	k->ctx = 0;
+
+	if (syscall(__NR_io_setup, depth, &k->ctx) < 0) {
+		printf("ERROR: io_setup errno %d '%s'\n", errno, act_strerror(errno));
+
+		if (errno == EAGAIN) {
+			printf("try raising /proc/sys/fs/aio-max-nr\n");
+		}
+
+		return false;
+	}
+
+	k->iocbs = calloc(depth, sizeof(struct iocb));
+	k->free_iocbs = malloc(depth * sizeof(struct iocb*));
+	k->events = malloc(depth * sizeof(struct io_event));
+
+	if (k->iocbs == NULL || k->free_iocbs == NULL || k->events == NULL) {
+		printf("ERROR: creating aio context (malloc)\n");
+		kaio_destroy(k);
+		return false;
+	}
+
+	for (k->n_free = 0; k->n_free < depth; k->n_free++) {
+		k->free_iocbs[k->n_free] = &k->iocbs[k->n_free];
+	}
+
+	return true;
+}
+
+static void
+kaio_destroy(kaio* k)
+{
+	syscall(__NR_io_destroy, k->ctx);
+	free(k->iocbs);
+	free(k->free_iocbs);
+	free(k->events);
+}
+
+static bool
+kaio_submit(kaio* k, io_op* op)
+{
+	struct iocb* cb = k->free_iocbs[--k->n_free];
+
+	memset(cb, 0, sizeof(struct iocb));
+
+	cb->aio_data = (uint64_t)op;
+	cb->aio_lio_opcode = op->is_write ? IOCB_CMD_PWRITE : IOCB_CMD_PREAD;
+	cb->aio_fildes = (uint32_t)op->fd;
+	cb->aio_buf = (uint64_t)op->buf;
+	cb->aio_nbytes = op->size;
+	cb->aio_offset = (int64_t)op->offset;
+
+	while (syscall(__NR_io_submit, k->ctx, 1, &cb) != 1) {
+		if (errno != EINTR && errno != EAGAIN) {
+			printf("ERROR: io_submit errno %d '%s'\n", errno,
+					act_strerror(errno));
+			k->free_iocbs[k->n_free++] = cb;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static uint32_t
+kaio_reap(kaio* k, io_op** ops, uint32_t max_ops, uint64_t timeout_us)
+{
+	struct timespec ts = {
+			.tv_sec = (time_t)(timeout_us / 1000000),
+			.tv_nsec = (long)((timeout_us % 1000000) * 1000)
+	};
+
+	long n_events = syscall(__NR_io_getevents, k->ctx,
+			timeout_us == 0 ? 0 : 1, max_ops, k->events, &ts);
+
+	if (n_events < 0) {
+		if (errno != EINTR) {
+			printf("ERROR: io_getevents errno %d '%s'\n", errno,
+					act_strerror(errno));
+		}
+
+		return 0;
+	}
+
+	for (long i = 0; i < n_events; i++) {
+		struct io_event* ev = &k->events[i];
+		io_op* op = (io_op*)ev->data;
+
+		op->res = (int32_t)ev->res;
+		ops[i] = op;
+		k->free_iocbs[k->n_free++] = (struct iocb*)ev->obj;
+	}
+
+	return (uint32_t)n_events;
+}
+
+
+//==========================================================
+// Local helpers - io_uring, via raw syscalls.
+//
+
+#ifdef HAS_URING
+
+static bool
+uring_create(uring* r, uint32_t depth)
+{
+	struct io_uring_params p;
+
+	memset(&p, 0, sizeof(p));
+
+	r->fd = (int)syscall(__NR_io_uring_setup, depth, &p);
+
+	if (r->fd < 0) {
+		printf("ERROR: io_uring_setup errno %d '%s'\n", errno,
+				act_strerror(errno));
+		return false;
+	}
+
+	// Needed for timed waits - kernel 5.11 or later.
+	if ((p.features & IORING_FEAT_EXT_ARG) == 0) {
+		printf("ERROR: io_uring needs kernel 5.11+ - try io-engine aio\n");
+		close(r->fd);
+		return false;
+	}
+
+	r->sq_sz = p.sq_off.array + (p.sq_entries * sizeof(uint32_t));
+	r->cq_sz = p.cq_off.cqes + (p.cq_entries * sizeof(struct io_uring_cqe));
+
+	bool single_mmap = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+
+	if (single_mmap && r->cq_sz > r->sq_sz) {
+		r->sq_sz = r->cq_sz;
+	}
+
+	r->sq_ptr = mmap(NULL, r->sq_sz, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+
+	if (r->sq_ptr == MAP_FAILED) {
+		printf("ERROR: io_uring sq ring mmap errno %d '%s'\n", errno,
+				act_strerror(errno));
+		close(r->fd);
+		return false;
+	}
+
+	if (single_mmap) {
+		r->cq_ptr = r->sq_ptr;
+		r->cq_sz = 0; // so we don't unmap twice
+	}
+	else {
+		r->cq_ptr = mmap(NULL, r->cq_sz, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+
+		if (r->cq_ptr == MAP_FAILED) {
+			printf("ERROR: io_uring cq ring mmap errno %d '%s'\n", errno,
+					act_strerror(errno));
+			munmap(r->sq_ptr, r->sq_sz);
+			close(r->fd);
+			return false;
+		}
+	}
+
+	r->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+	r->sqes = mmap(NULL, r->sqes_sz, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+
+	if (r->sqes == MAP_FAILED) {
+		printf("ERROR: io_uring sqes mmap errno %d '%s'\n", errno,
+				act_strerror(errno));
+		munmap(r->sq_ptr, r->sq_sz);
+
+		if (r->cq_sz != 0) {
+			munmap(r->cq_ptr, r->cq_sz);
+		}
+
+		close(r->fd);
+		return false;
+	}
+
+	uint8_t* sq = (uint8_t*)r->sq_ptr;
+	uint8_t* cq = (uint8_t*)r->cq_ptr;
+
+	r->sq_tail = (uint32_t*)(sq + p.sq_off.tail);
+	r->sq_mask = (uint32_t*)(sq + p.sq_off.ring_mask);
+	r->sq_array = (uint32_t*)(sq + p.sq_off.array);
+	r->cq_head = (uint32_t*)(cq + p.cq_off.head);
+	r->cq_tail = (uint32_t*)(cq + p.cq_off.tail);
+	r->cq_mask = (uint32_t*)(cq + p.cq_off.ring_mask);
+	r->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+
+	return true;
+}
+
+static void
+uring_destroy(uring* r)
+{
+	munmap(r->sqes, r->sqes_sz);
+	munmap(r->sq_ptr, r->sq_sz);
+
+	if (r->cq_sz != 0) {
+		munmap(r->cq_ptr, r->cq_sz);
+	}
+
+	close(r->fd);
+}
+
+static bool
+uring_submit(uring* r, io_op* op)
+{
+	// We're the only producer, so we own the tail.
+	uint32_t tail = *r->sq_tail;
+	uint32_t ix = tail & *r->sq_mask;
+	struct io_uring_sqe* sqe = &r->sqes[ix];
+
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+
+	sqe->opcode = op->is_write ? IORING_OP_WRITE : IORING_OP_READ;
+	sqe->fd = op->fd;
+	sqe->addr = (uint64_t)op->buf;
+	sqe->len = op->size;
+	sqe->off = op->offset;
+	sqe->user_data = (uint64_t)op;
+
+	r->sq_array[ix] = ix;
+
+	__atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+	r->n_unsubmitted++;
+
+	int ret;
+
+	while ((ret = (int)syscall(__NR_io_uring_enter, r->fd, r->n_unsubmitted, 0,
+			0, NULL, 0)) < 0 && errno == EINTR) {
+		;
+	}
+
+	if (ret < 0) {
+		// The sqe is published - on a transient error, kernel will pick it up
+		// on a later enter.
+		if (errno != EAGAIN && errno != EBUSY) {
+			printf("ERROR: io_uring_enter submit errno %d '%s'\n", errno,
+					act_strerror(errno));
+
+			// No SQPOLL, so kernel only reads sqes in enter - withdraw it.
+			__atomic_store_n(r->sq_tail, tail, __ATOMIC_RELEASE);
+			r->n_unsubmitted--;
+
+			return false;
+		}
+	}
+	else {
+		r->n_unsubmitted -= (uint32_t)ret;
+	}
+
+	return true;
+}
+
+static uint32_t
+uring_reap(uring* r, io_op** ops, uint32_t max_ops, uint64_t timeout_us)
+{
+	uint32_t head = *r->cq_head;
+	uint32_t tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+
+	if (head == tail && timeout_us != 0) {
+		struct __kernel_timespec ts = {
+				.tv_sec = (int64_t)(timeout_us / 1000000),
+				.tv_nsec = (long long)((timeout_us % 1000000) * 1000)
+		};
+
+		struct io_uring_getevents_arg arg = {
+				.sigmask = 0,
+				.sigmask_sz = _NSIG / 8,
+				.ts = (uint64_t)&ts
+		};
+
+		int ret = (int)syscall(__NR_io_uring_enter, r->fd, r->n_unsubmitted,
+				1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg,
+				sizeof(arg));
+
+		if (ret >= 0) {
+			r->n_unsubmitted -= (uint32_t)ret;
+		}
+		else if (errno != ETIME && errno != EINTR && errno != EAGAIN &&
+				errno != EBUSY) {
+			printf("ERROR: io_uring_enter wait errno %d '%s'\n", errno,
+					act_strerror(errno));
+		}
+
+		tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+	}
+
+	uint32_t n_ops = 0;
+
+	while (head != tail && n_ops < max_ops) {
+		struct io_uring_cqe* cqe = &r->cqes[head & *r->cq_mask];
+		io_op* op = (io_op*)cqe->user_data;
+
+		op->res = cqe->res;
+		ops[n_ops++] = op;
+		head++;
+	}
+
+	__atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+
+	return n_ops;
+}
+
+#endif // HAS_URING
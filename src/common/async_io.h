@@ -0,0 +1,77 @@
+/*
+ * async_io.h
+ *
+ * Copyright (c) 2020 Aerospike, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+typedef enum {
+	IO_ENGINE_SYNC,
+	IO_ENGINE_URING,
+	IO_ENGINE_AIO,
+	IO_ENGINE_INVALID
+} io_engine;
+
+// One device operation. Caller owns the op (and its buffer) until the op is
+// returned by async_io_reap().
+typedef struct io_op_s {
+	void* udata;        // caller's context
+	uint32_t tag;       // caller's op type
+	uint64_t sched_ns;  // caller's intended start time, if paced
+	uint32_t slot;      // caller's index for the op, e.g. of its buffers
+	int fd;
+	bool is_write;
+	uint8_t* buf;
+	uint32_t size;
+	uint64_t offset;
+	uint64_t start_ns;  // set by async_io_submit()
+	int32_t res;        // set on completion - bytes done, or -errno
+} io_op;
+
+typedef struct async_io_s async_io;
+
+
+//==========================================================
+// Public API.
+//
+
+io_engine io_engine_from_name(const char* name);
+const char* io_engine_name(io_engine engine);
+
+async_io* async_io_create(io_engine engine, uint32_t depth);
+void async_io_destroy(async_io* aio);
+uint32_t async_io_in_flight(const async_io* aio);
+bool async_io_submit(async_io* aio, io_op* op);
+uint32_t async_io_reap(async_io* aio, io_op** ops, uint32_t max_ops,
+		uint64_t timeout_us);
@@ -0,0 +1,81 @@
+/*
+ * buf_pool.c
+ *
+ * Copyright (c) 2020 Aerospike, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "buf_pool.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+//==========================================================
+// Public API.
+//
+
+//------------------------------------------------
+// Allocate 'n_bufs' buffers of at least 'buf_size'
+// bytes, each aligned for direct io.
+//
+bool
+buf_pool_init(buf_pool* pool, uint32_t n_bufs, uint32_t buf_size)
+{
+	pool->mem = NULL;
+	pool->buf_size = (buf_size + BUF_POOL_ALIGN - 1) & ~(BUF_POOL_ALIGN - 1);
+	pool->n_bufs = n_bufs;
+
+	if (pool->buf_size == 0 || n_bufs == 0) {
+		printf("ERROR: empty buffer pool\n");
+		return false;
+	}
+
+	void* pv;
+
+	if (posix_memalign(&pv, BUF_POOL_ALIGN,
+			(size_t)n_bufs * pool->buf_size) != 0) {
+		printf("ERROR: buffer pool of %u x %u bytes (posix_memalign)\n",
+				n_bufs, pool->buf_size);
+		return false;
+	}
+
+	pool->mem = (uint8_t*)pv;
+
+	return true;
+}
+
+//------------------------------------------------
+// Free a pool's buffers. Safe to call on a pool
+// whose init failed.
+//
+void
+buf_pool_free(buf_pool* pool)
+{
+	free(pool->mem);
+	pool->mem = NULL;
+}
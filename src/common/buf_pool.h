@@ -0,0 +1,67 @@
+/*
+ * buf_pool.h
+ *
+ * Copyright (c) 2020 Aerospike, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+#define BUF_POOL_ALIGN 4096
+
+// A thread's fixed set of equal-sized, aligned io buffers, carved from one
+// allocation made before the thread starts doing io.
+typedef struct buf_pool_s {
+	uint8_t* mem;
+	uint32_t buf_size;  // rounded up to BUF_POOL_ALIGN
+	uint32_t n_bufs;
+} buf_pool;
+
+
+//==========================================================
+// Public API.
+//
+
+bool buf_pool_init(buf_pool* pool, uint32_t n_bufs, uint32_t buf_size);
+void buf_pool_free(buf_pool* pool);
+
+
+//==========================================================
+// Public API - inlines.
+//
+
+static inline uint8_t*
+buf_pool_get(const buf_pool* pool, uint32_t i)
+{
+	return pool->mem + ((size_t)i * pool->buf_size);
+}
@@ -28,6 +28,8 @@
 
 #include "cfg.h"
 
+#include <math.h>
+#include <sched.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdlib.h>
@@ -35,6 +37,13 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "async_io.h"
+#include "hardware.h"
+#include "interval_log.h"
+#include "offset_dist.h"
+#include "pacer.h"
+#include "thread_cfg.h"
+
 
 //==========================================================
 // Public API.
@@ -86,6 +95,28 @@ parse_uint32()
 	return (uint32_t)u64_val;
 }
 
+// Returns NAN if missing or malformed - callers' range checks reject it.
+double
+parse_double()
+{
+	const char* val = strtok(NULL, WHITE_SPACE);
+
+	if (val == NULL) {
+		printf("ERROR: missing number config value\n");
+		return NAN;
+	}
+
+	char* end;
+	double d_val = strtod(val, &end);
+
+	if (*end != '\0') {
+		printf("ERROR: bad number '%s'\n", val);
+		return NAN;
+	}
+
+	return d_val;
+}
+
 bool
 parse_yes_no()
 {
@@ -93,3 +124,143 @@ parse_yes_no()
 
 	return val != NULL && *val == 'y';
 }
+
+io_engine
+parse_io_engine()
+{
+	const char* val = strtok(NULL, WHITE_SPACE);
+
+	if (val == NULL) {
+		printf("ERROR: missing io engine config value\n");
+		return IO_ENGINE_INVALID;
+	}
+
+	io_engine engine = io_engine_from_name(val);
+
+	if (engine == IO_ENGINE_INVALID) {
+		printf("ERROR: unknown io engine '%s'\n", val);
+	}
+
+	return engine;
+}
+
+arrival_dist
+parse_arrival_dist()
+{
+	const char* val = strtok(NULL, WHITE_SPACE);
+
+	if (val == NULL) {
+		printf("ERROR: missing arrival distribution config value\n");
+		return ARRIVAL_INVALID;
+	}
+
+	arrival_dist dist = arrival_dist_from_name(val);
+
+	if (dist == ARRIVAL_INVALID) {
+		printf("ERROR: unknown arrival distribution '%s'\n", val);
+	}
+
+	return dist;
+}
+
+offset_dist_type
+parse_offset_dist_type()
+{
+	const char* val = strtok(NULL, WHITE_SPACE);
+
+	if (val == NULL) {
+		printf("ERROR: missing offset distribution config value\n");
+		return OFFSET_DIST_INVALID;
+	}
+
+	offset_dist_type type = offset_dist_type_from_name(val);
+
+	if (type == OFFSET_DIST_INVALID) {
+		printf("ERROR: unknown offset distribution '%s'\n", val);
+	}
+
+	return type;
+}
+
+bool
+parse_file_name(char* name, size_t size)
+{
+	const char* val = strtok(NULL, WHITE_SPACE);
+
+	if (val == NULL) {
+		printf("ERROR: missing file name config value\n");
+		return false;
+	}
+
+	if (strlen(val) >= size) {
+		printf("ERROR: file name too long '%s'\n", val);
+		return false;
+	}
+
+	// Explicitly none, as shown in configuration echo.
+	strcpy(name, strcmp(val, "none") == 0 ? "" : val);
+
+	return true;
+}
+
+interval_log_format
+parse_interval_log_format()
+{
+	const char* val = strtok(NULL, WHITE_SPACE);
+
+	if (val == NULL) {
+		printf("ERROR: missing interval log format config value\n");
+		return INTERVAL_LOG_INVALID;
+	}
+
+	interval_log_format format = interval_log_format_from_name(val);
+
+	if (format == INTERVAL_LOG_INVALID) {
+		printf("ERROR: unknown interval log format '%s'\n", val);
+	}
+
+	return format;
+}
+
+void
+parse_thread_cpus(thread_cfg* cfg)
+{
+	const char* val = strtok(NULL, WHITE_SPACE);
+
+	CPU_ZERO(&cfg->cpus);
+
+	if (val == NULL) {
+		printf("ERROR: missing CPU list config value\n");
+		cfg->is_pinned = true; // so it's rejected
+		return;
+	}
+
+	if (strcmp(val, "any") == 0) {
+		cfg->is_pinned = false;
+		return;
+	}
+
+	cfg->is_pinned = true;
+
+	if (! cpu_list_from_string(val, &cfg->cpus)) {
+		printf("ERROR: invalid CPU list '%s'\n", val);
+		CPU_ZERO(&cfg->cpus);
+	}
+}
+
+//------------------------------------------------
+// As in Aerospike server - 5 per CPU the service
+// threads may run on.
+//
+uint32_t
+default_service_threads(const thread_cfg* cpus)
+{
+	const cpu_topology* topo = cpu_topology_get();
+
+	if (topo == NULL) {
+		return 0;
+	}
+
+	return 5 * usable_cpus_in(topo,
+			cpus->is_pinned ? &cpus->cpus : &topo->cpus);
+}
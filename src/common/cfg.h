@@ -28,11 +28,18 @@
 // Includes.
 //
 
+#include <sched.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 
+#include "async_io.h"
+#include "interval_log.h"
+#include "offset_dist.h"
+#include "pacer.h"
+#include "thread_cfg.h"
+
 
 //==========================================================
 // Typedefs & constants.
@@ -40,6 +47,7 @@
 
 #define WHITE_SPACE " \t\n\r"
 #define MAX_DEVICE_NAME_SIZE 128
+#define MAX_FILE_NAME_SIZE 256
 
 
 //==========================================================
@@ -49,10 +57,29 @@
 void parse_device_names(size_t max_num_devices,
 		char names[][MAX_DEVICE_NAME_SIZE], uint32_t* p_num_devices);
 uint32_t parse_uint32();
+double parse_double();
 bool parse_yes_no();
+io_engine parse_io_engine();
+arrival_dist parse_arrival_dist();
+offset_dist_type parse_offset_dist_type();
+void parse_thread_cpus(thread_cfg* cfg);
+bool parse_file_name(char* name, size_t size);
+interval_log_format parse_interval_log_format();
+uint32_t default_service_threads(const thread_cfg* cpus);
 
 static inline void
 configuration_error(const char* tag)
 {
 	printf("ERROR: invalid or missing configuration of '%s'\n", tag);
 }
+
+static inline bool
+check_thread_cpus(const thread_cfg* cfg, const char* tag)
+{
+	if (cfg->is_pinned && CPU_COUNT(&cfg->cpus) == 0) {
+		configuration_error(tag);
+		return false;
+	}
+
+	return true;
+}
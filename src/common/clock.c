@@ -0,0 +1,186 @@
+/*
+ * clock.c
+ *
+ * Copyright (c) 2020 Aerospike, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "clock.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+#define CALIBRATION_NS (100 * 1000 * 1000)
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static uint64_t tick_frequency(const char** reason);
+
+
+//==========================================================
+// Globals.
+//
+
+tick_clock g_tick_clock = { .enabled = false };
+
+
+//==========================================================
+// Public API.
+//
+
+//------------------------------------------------
+// Switch get_ns() (and get_us(), get_ms()) to the
+// CPU's cycle counter - rdtsc on x86_64, cntvct_el0
+// on aarch64 - if it runs at a constant rate. Must
+// be called before any other threads are started.
+// Otherwise, clock_gettime() remains in use.
+//
+void
+clock_init()
+{
+	const char* reason = "unsupported architecture";
+	uint64_t freq = tick_frequency(&reason);
+
+	if (freq == 0) {
+		printf("using clock_gettime() for timestamps - %s\n", reason);
+		return;
+	}
+
+	g_tick_clock.ns_per_tick = (1000000000ULL << 32) / freq;
+	g_tick_clock.base_ticks = read_ticks();
+	g_tick_clock.base_ns = get_monotonic_ns();
+	g_tick_clock.enabled = true;
+
+	printf("using cycle counter at %.3lf MHz for timestamps\n",
+			(double)freq / 1000000);
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+#if defined(__x86_64__)
+
+//------------------------------------------------
+// Sample CLOCK_MONOTONIC with the TSC read in
+// between, choosing the tightest of a few tries.
+//
+static void
+sample_ns_and_ticks(uint64_t* ns, uint64_t* ticks)
+{
+	uint64_t best_gap_ns = UINT64_MAX;
+
+	for (uint32_t i = 0; i < 5; i++) {
+		uint64_t before_ns = get_monotonic_ns();
+		uint64_t t = read_ticks();
+		uint64_t after_ns = get_monotonic_ns();
+
+		if (after_ns - before_ns < best_gap_ns) {
+			best_gap_ns = after_ns - before_ns;
+			*ns = before_ns + (best_gap_ns / 2);
+			*ticks = t;
+		}
+	}
+}
+
+//------------------------------------------------
+// Measure TSC frequency against CLOCK_MONOTONIC.
+// Returns 0 if the TSC isn't invariant.
+//
+static uint64_t
+tick_frequency(const char** reason)
+{
+	uint32_t eax, ebx, ecx, edx;
+
+	// Invariant TSC is CPUID leaf 0x80000007, EDX bit 8.
+	if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) == 0 ||
+			(edx & (1 << 8)) == 0) {
+		*reason = "no invariant TSC";
+		return 0;
+	}
+
+	uint64_t start_ns, start_ticks;
+	uint64_t stop_ns, stop_ticks;
+
+	sample_ns_and_ticks(&start_ns, &start_ticks);
+
+	struct timespec ts = { .tv_sec = 0, .tv_nsec = CALIBRATION_NS };
+
+	nanosleep(&ts, NULL);
+
+	sample_ns_and_ticks(&stop_ns, &stop_ticks);
+
+	if (stop_ticks <= start_ticks || stop_ns <= start_ns) {
+		*reason = "TSC calibration failed";
+		return 0;
+	}
+
+	return (uint64_t)((double)(stop_ticks - start_ticks) * 1000000000.0 /
+			(double)(stop_ns - start_ns));
+}
+
+#elif defined(__aarch64__)
+
+//------------------------------------------------
+// The generic timer's frequency is fixed, and is
+// published in cntfrq_el0.
+//
+static uint64_t
+tick_frequency(const char** reason)
+{
+	uint64_t freq;
+
+	__asm__ __volatile__ ("mrs %0, cntfrq_el0" : "=r" (freq));
+
+	if (freq == 0) {
+		*reason = "cntfrq_el0 not set";
+	}
+
+	return freq;
+}
+
+#else
+
+static uint64_t
+tick_frequency(const char** reason)
+{
+	return 0;
+}
+
+#endif
@@ -28,34 +28,91 @@
 // Includes.
 //
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <time.h>
 
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+// Cycle counter to nanoseconds conversion, set up by clock_init().
+typedef struct tick_clock_s {
+	bool enabled;
+	uint64_t base_ticks;
+	uint64_t base_ns;       // CLOCK_MONOTONIC time at base_ticks
+	uint64_t ns_per_tick;   // 32.32 fixed point
+} tick_clock;
+
+
+//==========================================================
+// Globals.
+//
+
+extern tick_clock g_tick_clock;
+
 
 //==========================================================
 // Public API.
 //
 
+void clock_init();
+
 static inline uint64_t
-get_ms()
+get_monotonic_ns()
 {
 	struct timespec ts;
 	clock_gettime(CLOCK_MONOTONIC, &ts);
-	return ((uint64_t)ts.tv_nsec / 1000000) + ((uint64_t)ts.tv_sec * 1000);
+	return (uint64_t)ts.tv_nsec + ((uint64_t)ts.tv_sec * 1000000000);
 }
 
 static inline uint64_t
-get_us()
+read_ticks()
 {
-	struct timespec ts;
-	clock_gettime(CLOCK_MONOTONIC, &ts);
-	return ((uint64_t)ts.tv_nsec / 1000) + ((uint64_t)ts.tv_sec * 1000000);
+#if defined(__x86_64__)
+	return __rdtsc();
+#elif defined(__aarch64__)
+	uint64_t ticks;
+	__asm__ __volatile__ ("isb; mrs %0, cntvct_el0" : "=r" (ticks) :: "memory");
+	return ticks;
+#else
+	return 0;
+#endif
 }
 
 static inline uint64_t
 get_ns()
 {
-	struct timespec ts;
-	clock_gettime(CLOCK_MONOTONIC, &ts);
-	return (uint64_t)ts.tv_nsec + ((uint64_t)ts.tv_sec * 1000000000);
+	if (! g_tick_clock.enabled) {
+		return get_monotonic_ns();
+	}
+
+	// Another CPU's counter may be very slightly behind the base.
+	int64_t ticks = (int64_t)(read_ticks() - g_tick_clock.base_ticks);
+
+	if (ticks < 0) {
+		ticks = 0;
+	}
+
+	return g_tick_clock.base_ns + (uint64_t)
+			(((unsigned __int128)ticks * g_tick_clock.ns_per_tick) >> 32);
+}
+
+// Derived from get_ns(), so all three always agree.
+
+static inline uint64_t
+get_ms()
+{
+	return get_ns() / 1000000;
+}
+
+static inline uint64_t
+get_us()
+{
+	return get_ns() / 1000;
 }
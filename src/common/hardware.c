@@ -31,6 +31,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <sched.h>
 #include <stdbool.h>
 #include <stddef.h>
@@ -39,6 +40,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
 
 #include "trace.h"
 
@@ -58,8 +61,24 @@ typedef enum {
 // Forward declarations.
 //
 
+static bool device_sys_path(const char* path, char* sys_path);
+static void find_queue_irqs(const char* disk, hw_queue* queues,
+		uint32_t n_queues);
+static int32_t irq_queue_ix(const char* action, const char* ctrl);
+static bool discover_topology(cpu_topology* topo);
+static bool discover_numa_nodes(cpu_topology* topo);
+static bool numa_node_cpus(uint32_t node, cpu_set_t* mask);
+static void discover_usable_cpus(cpu_topology* topo);
+static bool cgroup_dir(const char* controller, char* dir, size_t size,
+		size_t* root_len);
+static bool cgroup_cpuset(cpu_set_t* mask);
+static uint32_t cgroup_quota_cpus();
+static uint32_t quota_cpus_v1(const char* dir);
+static uint32_t quota_cpus_v2(const char* dir);
+static bool parent_dir(char* dir, size_t root_len);
+static uint16_t find_or_add(uint32_t* ids, uint32_t* n_ids, uint32_t id);
 static file_res read_list(const char* path, cpu_set_t* mask);
-static file_res read_index(const char* path, uint16_t* val);
+static file_res read_signed(const char* path, int64_t* val);
 static file_res read_file(const char* path, void* buf, size_t* limit);
 
 
@@ -67,96 +86,86 @@ static file_res read_file(const char* path, void* buf, size_t* limit);
 // Public API.
 //
 
-uint32_t
-num_cpus()
+//------------------------------------------------
+// Get the online CPUs and how they're arranged.
+// Discovered on first call, which must be before
+// any other threads are started. Returns NULL if
+// discovery failed.
+//
+const cpu_topology*
+cpu_topology_get()
 {
-	cpu_set_t os_cpus_online;
+	static cpu_topology topo;
+	static bool is_discovered = false;
 
-	if (read_list("/sys/devices/system/cpu/online", &os_cpus_online) !=
-			FILE_RES_OK) {
-		printf("ERROR: couldn't read list of online CPUs\n");
-		return 0;
-	}
-
-	uint16_t n_cpus = 0;
-	uint16_t n_os_cpus;
-
-	for (n_os_cpus = 0; n_os_cpus < CPU_SETSIZE; n_os_cpus++) {
-		char path[1000];
+	if (! is_discovered) {
+		if (! discover_topology(&topo)) {
+			return NULL;
+		}
 
-		snprintf(path, sizeof(path),
-				"/sys/devices/system/cpu/cpu%hu/topology/physical_package_id",
-				n_os_cpus);
+		is_discovered = true;
+	}
 
-		uint16_t i_os_package;
-		file_res res = read_index(path, &i_os_package);
+	return &topo;
+}
 
-		if (res == FILE_RES_NOT_FOUND) {
-			break; // we've processed all available CPUs - done
-		}
+//------------------------------------------------
+// Number of CPUs in a set this process may use,
+// capped by any cgroup CPU quota.
+//
+uint32_t
+usable_cpus_in(const cpu_topology* topo, const cpu_set_t* cpus)
+{
+	cpu_set_t usable;
 
-		if (res != FILE_RES_OK) {
-			printf("ERROR: reading OS package index from %s\n", path);
-			return 0;
-		}
+	CPU_AND(&usable, &topo->usable_cpus, cpus);
 
-		// Only consider CPUs that are actually in use.
-		if (CPU_ISSET(n_os_cpus, &os_cpus_online)) {
-			n_cpus++;
-		}
-	}
+	uint32_t n_cpus = (uint32_t)CPU_COUNT(&usable);
 
-	if (n_os_cpus == CPU_SETSIZE) {
-		printf("ERROR: too many CPUs\n");
-		return 0;
+	if (topo->quota_cpus != 0 && n_cpus > topo->quota_cpus) {
+		n_cpus = topo->quota_cpus;
 	}
 
-	printf("detected %" PRIu32 " CPUs\n\n", n_cpus);
-
 	return n_cpus;
 }
 
-
-//==========================================================
-// Local helpers.
+//------------------------------------------------
+// Parse a CPU list like "0-3,8,10-11", as used in
+// sysfs and by taskset.
 //
-
-static file_res
-read_list(const char* path, cpu_set_t* mask)
+bool
+cpu_list_from_string(const char* list, cpu_set_t* mask)
 {
-	char buf[1000];
-	size_t limit = sizeof(buf);
-	file_res res = read_file(path, buf, &limit);
-
-	if (res != FILE_RES_OK) {
-		return res;
-	}
-
-	buf[limit - 1] = '\0';
 	CPU_ZERO(mask);
 
-	char* at = buf;
+	const char* at = list;
 
 	while (true) {
 		char* delim;
 		uint64_t from = strtoul(at, &delim, 10);
 		uint64_t thru;
 
+		if (delim == at) {
+			return false;
+		}
+
 		if (*delim == ',' || *delim == '\0'){
 			thru = from;
 		}
 		else if (*delim == '-') {
 			at = delim + 1;
 			thru = strtoul(at, &delim, 10);
+
+			if (delim == at) {
+				return false;
+			}
 		}
 		else {
-			printf("ERROR: invalid list '%s' in %s\n", buf, path);
-			return FILE_RES_ERROR;
+			return false;
 		}
 
 		if (from >= CPU_SETSIZE || thru >= CPU_SETSIZE || from > thru) {
-			printf("ERROR: invalid list '%s' in %s\n", buf, path);
-			return FILE_RES_ERROR;
+			return false;
 		}
 
 		for (size_t i = from; i <= thru; ++i) {
@@ -170,11 +179,711 @@ read_list(const char* path, cpu_set_t* mask)
 		at = delim + 1;
 	}
 
+	return true;
+}
+
+//------------------------------------------------
+// Format a CPU set as a list like "0-3,8,10-11".
+//
+void
+cpu_list_to_string(const cpu_set_t* mask, char* buf, size_t size)
+{
+	size_t len = 0;
+
+	buf[0] = '\0';
+
+	for (uint32_t from = 0; from < CPU_SETSIZE && len < size; from++) {
+		if (! CPU_ISSET(from, mask)) {
+			continue;
+		}
+
+		uint32_t thru = from;
+
+		while (thru + 1 < CPU_SETSIZE && CPU_ISSET(thru + 1, mask)) {
+			thru++;
+		}
+
+		const char* sep = len == 0 ? "" : ",";
+
+		len += from == thru ?
+				(size_t)snprintf(buf + len, size - len, "%s%u", sep, from) :
+				(size_t)snprintf(buf + len, size - len, "%s%u-%u", sep, from,
+						thru);
+
+		from = thru;
+	}
+}
+
+//------------------------------------------------
+// Find the NUMA node a device (or the device a
+// file is on) is attached to - the nearest sysfs
+// ancestor of its block device with a numa_node.
+// Returns -1 if there's none, or it's unknown.
+//
+int32_t
+device_numa_node(const char* path)
+{
+	char sys_path[PATH_MAX];
+
+	if (! device_sys_path(path, sys_path)) {
+		return -1;
+	}
+
+	// Walk up from e.g. .../0000:00:02.0/virtio1/block/vda/vda1.
+	while (strcmp(sys_path, "/sys/devices") != 0) {
+		char node_path[PATH_MAX + 20];
+
+		snprintf(node_path, sizeof(node_path), "%s/numa_node", sys_path);
+
+		int64_t node;
+		file_res res = read_signed(node_path, &node);
+
+		if (res == FILE_RES_OK) {
+			return node < 0 || node > INT32_MAX ? -1 : (int32_t)node;
+		}
+
+		if (res != FILE_RES_NOT_FOUND) {
+			return -1;
+		}
+
+		char* slash = strrchr(sys_path, '/');
+
+		if (slash == NULL || slash == sys_path) {
+			break;
+		}
+
+		*slash = '\0';
+	}
+
+	return -1;
+}
+
+//------------------------------------------------
+// Get the blk-mq hardware queues of a device (or
+// of the device a file is on) - which CPUs submit
+// to each, and which take each one's completion
+// interrupt. Interrupts are matched to queues by
+// NVMe and virtio-blk naming - with other drivers
+// they're left empty. Returns number of queues, 0
+// if unknown.
+//
+uint32_t
+device_hw_queues(const char* path, hw_queue* queues, uint32_t max_queues)
+{
+	char disk[PATH_MAX];
+
+	if (! device_sys_path(path, disk)) {
+		return 0;
+	}
+
+	char file_path[PATH_MAX + 100];
+
+	snprintf(file_path, sizeof(file_path), "%s/partition", disk);
+
+	// A partition uses its disk's queues.
+	if (access(file_path, F_OK) == 0) {
+		*strrchr(disk, '/') = '\0';
+	}
+
+	uint32_t n_queues;
+
+	for (n_queues = 0; n_queues < max_queues; n_queues++) {
+		snprintf(file_path, sizeof(file_path), "%s/mq/%u/cpu_list", disk,
+				n_queues);
+
+		if (read_list(file_path, &queues[n_queues].cpus) != FILE_RES_OK) {
+			break;
+		}
+
+		CPU_ZERO(&queues[n_queues].irq_cpus);
+	}
+
+	if (n_queues != 0) {
+		find_queue_irqs(disk, queues, n_queues);
+	}
+
+	return n_queues;
+}
+
+
+
+//==========================================================
+// Local helpers.
+//
+
+// Resolve a device (or the device a file is on) to its sysfs directory.
+static bool
+device_sys_path(const char* path, char* sys_path)
+{
+	struct stat st;
+
+	if (stat(path, &st) != 0) {
+		return false;
+	}
+
+	dev_t dev = S_ISBLK(st.st_mode) ? st.st_rdev : st.st_dev;
+	char link[100];
+
+	snprintf(link, sizeof(link), "/sys/dev/block/%u:%u", major(dev),
+			minor(dev));
+
+	return realpath(link, sys_path) != NULL;
+}
+
+static void
+find_queue_irqs(const char* disk, hw_queue* queues, uint32_t n_queues)
+{
+	// The controller is the disk's parent, as in .../nvme/nvme0/nvme0n1, or
+	// grandparent, as in .../virtio1/block/vda.
+	char ctrl_path[PATH_MAX];
+
+	snprintf(ctrl_path, sizeof(ctrl_path), "%s", disk);
+	*strrchr(ctrl_path, '/') = '\0';
+
+	char* ctrl = strrchr(ctrl_path, '/') + 1;
+
+	if (strcmp(ctrl, "block") == 0) {
+		ctrl[-1] = '\0';
+		ctrl = strrchr(ctrl_path, '/') + 1;
+	}
+
+	FILE* f = fopen("/proc/interrupts", "r");
+
+	if (f == NULL) {
+		return;
+	}
+
+	char* line = NULL;
+	size_t line_size = 0;
+
+	// Lines are like " 36:  17056  0  PCI-MSIX-0000:00:02.0 1-edge  nvme0q1".
+	while (getline(&line, &line_size, f) != -1) {
+		char* end;
+		uint64_t irq = strtoul(line, &end, 10);
+
+		if (end == line || *end != ':') {
+			continue; // header, or not a numbered interrupt
+		}
+
+		line[strcspn(line, "\n")] = '\0';
+
+		const char* action = strrchr(line, ' ');
+
+		if (action == NULL) {
+			continue;
+		}
+
+		int32_t ix = irq_queue_ix(action + 1, ctrl);
+
+		if (ix < 0 || (uint32_t)ix >= n_queues) {
+			continue;
+		}
+
+		char path[100];
+
+		snprintf(path, sizeof(path), "/proc/irq/%" PRIu64
+				"/effective_affinity_list", irq);
+
+		if (read_list(path, &queues[ix].irq_cpus) == FILE_RES_NOT_FOUND) {
+			snprintf(path, sizeof(path), "/proc/irq/%" PRIu64
+					"/smp_affinity_list", irq);
+			read_list(path, &queues[ix].irq_cpus);
+		}
+	}
+
+	free(line);
+	fclose(f);
+}
+
+// Returns the hardware queue an interrupt action like "nvme0q1" (queue 0 -
+// nvme0q0 is the admin queue) or "virtio1-req.0" is for, or -1 if none.
+static int32_t
+irq_queue_ix(const char* action, const char* ctrl)
+{
+	size_t len = strlen(ctrl);
+
+	if (strncmp(action, ctrl, len) != 0) {
+		return -1;
+	}
+
+	const char* suffix = action + len;
+	int64_t offset;
+
+	if (suffix[0] == 'q') {
+		suffix += 1;
+		offset = -1;
+	}
+	else if (strncmp(suffix, "-req.", 5) == 0) {
+		suffix += 5;
+		offset = 0;
+	}
+	else {
+		return -1;
+	}
+
+	char* end;
+	int64_t n = strtol(suffix, &end, 10);
+
+	if (end == suffix || *end != '\0' || n + offset < 0 ||
+			n + offset > INT32_MAX) {
+		return -1;
+	}
+
+	return (int32_t)(n + offset);
+}
+
+static bool
+discover_topology(cpu_topology* topo)
+{
+	memset(topo, 0, sizeof(cpu_topology));
+
+	if (read_list("/sys/devices/system/cpu/online", &topo->cpus) !=
+			FILE_RES_OK) {
+		printf("ERROR: couldn't read list of online CPUs\n");
+		return false;
+	}
+
+	// Core ids are only unique within a package, so key cores by both.
+	static uint32_t package_ids[CPU_SETSIZE];
+	static uint32_t core_keys[CPU_SETSIZE];
+
+	for (uint32_t i = 0; i < CPU_SETSIZE; i++) {
+		// Only consider CPUs that are actually in use.
+		if (! CPU_ISSET(i, &topo->cpus)) {
+			continue;
+		}
+
+		char path[1000];
+		int64_t package_id;
+		int64_t core_id;
+
+		snprintf(path, sizeof(path),
+				"/sys/devices/system/cpu/cpu%u/topology/physical_package_id",
+				i);
+
+		if (read_signed(path, &package_id) != FILE_RES_OK) {
+			printf("ERROR: reading OS package index from %s\n", path);
+			return false;
+		}
+
+		snprintf(path, sizeof(path),
+				"/sys/devices/system/cpu/cpu%u/topology/core_id", i);
+
+		if (read_signed(path, &core_id) != FILE_RES_OK) {
+			printf("ERROR: reading OS core index from %s\n", path);
+			return false;
+		}
+
+		// Some platforms report -1 if they don't know.
+		uint32_t package_ix = find_or_add(package_ids, &topo->n_packages,
+				package_id < 0 ? 0 : (uint32_t)package_id);
+
+		if (package_ix >= MAX_NUM_PACKAGES) {
+			printf("ERROR: too many CPU packages\n");
+			return false;
+		}
+
+		uint32_t core_key = (package_ix << 16) |
+				(core_id < 0 ? i : (uint32_t)core_id & 0xFFFF);
+
+		topo->cpu_package[i] = (uint16_t)package_ix;
+		topo->cpu_core[i] = find_or_add(core_keys, &topo->n_cores, core_key);
+		CPU_SET(i, &topo->package_cpus[package_ix]);
+		topo->n_cpus++;
+	}
+
+	if (! discover_numa_nodes(topo)) {
+		return false;
+	}
+
+	printf("detected %" PRIu32 " CPUs, %" PRIu32 " cores, %" PRIu32
+			" packages, %" PRIu32 " NUMA nodes\n", topo->n_cpus,
+			topo->n_cores, topo->n_packages, topo->n_numa_nodes);
+
+	for (uint32_t n = 0; n < topo->n_numa_nodes; n++) {
+		uint32_t node = topo->node_ids[n];
+		char buf[MAX_CPU_LIST_SIZE];
+
+		cpu_list_to_string(&topo->node_cpus[node], buf, sizeof(buf));
+		printf("NUMA node %" PRIu32 " CPUs: %s\n", node, buf);
+	}
+
+	discover_usable_cpus(topo);
+
+	if (topo->cpu_limit != NULL) {
+		printf("process may use %" PRIu32 " CPUs - limited by %s\n",
+				topo->n_usable_cpus, topo->cpu_limit);
+	}
+
+	printf("\n");
+
+	return true;
+}
+
+static bool
+discover_numa_nodes(cpu_topology* topo)
+{
+	cpu_set_t nodes;
+	file_res res = read_list("/sys/devices/system/node/online", &nodes);
+
+	// Kernels built without NUMA support have no node directory.
+	if (res == FILE_RES_NOT_FOUND) {
+		topo->n_numa_nodes = 1;
+		topo->node_ids[0] = 0;
+		CPU_OR(&topo->node_cpus[0], &topo->node_cpus[0], &topo->cpus);
+		return true;
+	}
+
+	if (res != FILE_RES_OK) {
+		printf("ERROR: couldn't read list of online NUMA nodes\n");
+		return false;
+	}
+
+	for (uint32_t node = 0; node < CPU_SETSIZE; node++) {
+		if (! CPU_ISSET(node, &nodes)) {
+			continue;
+		}
+
+		if (node >= MAX_NUM_NUMA_NODES) {
+			printf("ERROR: NUMA node %" PRIu32 " out of range\n", node);
+			return false;
+		}
+
+		cpu_set_t* node_cpus = &topo->node_cpus[node];
+
+		if (! numa_node_cpus(node, node_cpus)) {
+			return false;
+		}
+
+		CPU_AND(node_cpus, node_cpus, &topo->cpus);
+
+		for (uint32_t i = 0; i < CPU_SETSIZE; i++) {
+			if (CPU_ISSET(i, node_cpus)) {
+				topo->cpu_node[i] = (uint16_t)node;
+			}
+		}
+
+		topo->node_ids[topo->n_numa_nodes++] = node;
+	}
+
+	return true;
+}
+
+//------------------------------------------------
+// Get the CPUs on a NUMA node.
+//
+static bool
+numa_node_cpus(uint32_t node, cpu_set_t* mask)
+{
+	char path[100];
+
+	snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist",
+			node);
+
+	if (read_list(path, mask) != FILE_RES_OK) {
+		printf("ERROR: couldn't read CPUs of NUMA node %u\n", node);
+		return false;
+	}
+
+	return true;
+}
+
+static void
+discover_usable_cpus(cpu_topology* topo)
+{
+	cpu_set_t* usable = &topo->usable_cpus;
+	cpu_set_t allowed;
+
+	CPU_ZERO(usable);
+	CPU_OR(usable, usable, &topo->cpus);
+
+	// Check cpuset first - the kernel usually applies it to affinity too.
+	if (cgroup_cpuset(&allowed)) {
+		CPU_AND(usable, usable, &allowed);
+
+		if (CPU_COUNT(usable) < CPU_COUNT(&topo->cpus)) {
+			topo->cpu_limit = "cgroup cpuset";
+		}
+	}
+
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+		int n_before = CPU_COUNT(usable);
+
+		CPU_AND(usable, usable, &allowed);
+
+		if (CPU_COUNT(usable) < n_before) {
+			topo->cpu_limit = "CPU affinity";
+		}
+	}
+
+	// Don't leave nothing to run on if something above went wrong.
+	if (CPU_COUNT(usable) == 0) {
+		CPU_OR(usable, usable, &topo->cpus);
+		topo->cpu_limit = NULL;
+	}
+
+	topo->n_usable_cpus = (uint32_t)CPU_COUNT(usable);
+	topo->quota_cpus = cgroup_quota_cpus();
+
+	if (topo->quota_cpus != 0 && topo->quota_cpus < topo->n_usable_cpus) {
+		topo->n_usable_cpus = topo->quota_cpus;
+		topo->cpu_limit = "cgroup CPU quota";
+	}
+}
+
+//------------------------------------------------
+// Find this process' cgroup directory for a v1
+// controller, or for v2 if controller is NULL.
+// Also gets the length of the hierarchy's mount
+// point, which is as far up as a walk may go.
+//
+static bool
+cgroup_dir(const char* controller, char* dir, size_t size, size_t* root_len)
+{
+	FILE* f = fopen("/proc/self/cgroup", "r");
+
+	if (f == NULL) {
+		return false;
+	}
+
+	char line[1000];
+	bool found = false;
+
+	// Lines are like "4:cpu,cpuacct:/path" (v1) or "0::/path" (v2).
+	while (! found && fgets(line, sizeof(line), f) != NULL) {
+		char* controllers = strchr(line, ':');
+		char* path = controllers == NULL ? NULL : strchr(controllers + 1, ':');
+
+		if (path == NULL) {
+			continue;
+		}
+
+		*controllers++ = '\0';
+		*path++ = '\0';
+		path[strcspn(path, "\n")] = '\0';
+
+		if (controller == NULL) {
+			if (*controllers != '\0') {
+				continue;
+			}
+
+			const char* root = access("/sys/fs/cgroup/cgroup.controllers",
+					F_OK) == 0 ? "/sys/fs/cgroup" : "/sys/fs/cgroup/unified";
+
+			snprintf(dir, size, "%s%s", root, path);
+			*root_len = strlen(root);
+			found = true;
+			continue;
+		}
+
+		size_t len = strlen(controller);
+
+		for (char* at = strstr(controllers, controller); at != NULL;
+				at = strstr(at + 1, controller)) {
+			if ((at == controllers || at[-1] == ',') &&
+					(at[len] == ',' || at[len] == '\0')) {
+				// Mounted under the full list, e.g. /sys/fs/cgroup/cpu,cpuacct.
+				int root_end = snprintf(dir, size, "/sys/fs/cgroup/%s",
+						controllers);
+
+				snprintf(dir + root_end, size - (size_t)root_end, "%s", path);
+				*root_len = (size_t)root_end;
+				found = true;
+				break;
+			}
+		}
+	}
+
+	fclose(f);
+
+	if (! found) {
+		return false;
+	}
+
+	size_t dir_len = strlen(dir);
+
+	if (dir_len > *root_len && dir[dir_len - 1] == '/') {
+		dir[dir_len - 1] = '\0';
+	}
+
+	// With a cgroup namespace, as in most containers, the path shown may not
+	// be under the mount point - our cgroup is then the mount point itself.
+	if (access(dir, F_OK) != 0) {
+		dir[*root_len] = '\0';
+	}
+
+	return access(dir, F_OK) == 0;
+}
+
+static bool
+cgroup_cpuset(cpu_set_t* mask)
+{
+	static const char* const V1_FILES[] = {
+			"cpuset.effective_cpus", "cpuset.cpus"
+	};
+
+	char dir[PATH_MAX];
+	size_t root_len;
+	char path[PATH_MAX + 100];
+
+	if (cgroup_dir(NULL, dir, sizeof(dir), &root_len)) {
+		// Effective CPUs already account for ancestors, but only cgroups
+		// with the cpuset controller enabled have the file.
+		do {
+			snprintf(path, sizeof(path), "%s/cpuset.cpus.effective", dir);
+
+			if (read_list(path, mask) == FILE_RES_OK) {
+				return true;
+			}
+		} while (parent_dir(dir, root_len));
+	}
+
+	if (cgroup_dir("cpuset", dir, sizeof(dir), &root_len)) {
+		for (uint32_t i = 0; i < sizeof(V1_FILES) / sizeof(V1_FILES[0]); i++) {
+			snprintf(path, sizeof(path), "%s/%s", dir, V1_FILES[i]);
+
+			if (read_list(path, mask) == FILE_RES_OK) {
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+//------------------------------------------------
+// Get the tightest CPU quota of our cgroup and its
+// ancestors, in CPUs rounded up, or 0 if none.
+//
+static uint32_t
+cgroup_quota_cpus()
+{
+	char dir[PATH_MAX];
+	size_t root_len;
+	uint32_t (*quota_fn)(const char*) = quota_cpus_v2;
+
+	if (! cgroup_dir(NULL, dir, sizeof(dir), &root_len)) {
+		quota_fn = quota_cpus_v1;
+
+		if (! cgroup_dir("cpu", dir, sizeof(dir), &root_len)) {
+			return 0;
+		}
+	}
+
+	uint32_t min_cpus = 0;
+
+	do {
+		uint32_t cpus = quota_fn(dir);
+
+		if (cpus != 0 && (min_cpus == 0 || cpus < min_cpus)) {
+			min_cpus = cpus;
+		}
+	} while (parent_dir(dir, root_len));
+
+	return min_cpus;
+}
+
+// File cpu.cfs_quota_us is -1 if there's no quota.
+static uint32_t
+quota_cpus_v1(const char* dir)
+{
+	char path[PATH_MAX + 100];
+	int64_t quota;
+	int64_t period;
+
+	snprintf(path, sizeof(path), "%s/cpu.cfs_quota_us", dir);
+
+	if (read_signed(path, &quota) != FILE_RES_OK || quota <= 0) {
+		return 0;
+	}
+
+	snprintf(path, sizeof(path), "%s/cpu.cfs_period_us", dir);
+
+	if (read_signed(path, &period) != FILE_RES_OK || period <= 0) {
+		return 0;
+	}
+
+	return (uint32_t)((quota + period - 1) / period);
+}
+
+// File cpu.max is like "400000 100000", or "max 100000" if there's no quota.
+static uint32_t
+quota_cpus_v2(const char* dir)
+{
+	char path[PATH_MAX + 100];
+	char buf[100];
+	size_t limit = sizeof(buf);
+
+	snprintf(path, sizeof(path), "%s/cpu.max", dir);
+
+	if (read_file(path, buf, &limit) != FILE_RES_OK) {
+		return 0;
+	}
+
+	buf[limit - 1] = '\0';
+
+	uint64_t quota;
+	uint64_t period;
+
+	if (sscanf(buf, "%" SCNu64 " %" SCNu64, &quota, &period) != 2 ||
+			quota == 0 || period == 0) {
+		return 0;
+	}
+
+	return (uint32_t)((quota + period - 1) / period);
+}
+
+static bool
+parent_dir(char* dir, size_t root_len)
+{
+	char* slash = strrchr(dir, '/');
+
+	if (slash == NULL || (size_t)(slash - dir) < root_len) {
+		return false;
+	}
+
+	*slash = '\0';
+
+	return true;
+}
+
+static uint16_t
+find_or_add(uint32_t* ids, uint32_t* n_ids, uint32_t id)
+{
+	for (uint32_t i = 0; i < *n_ids; i++) {
+		if (ids[i] == id) {
+			return (uint16_t)i;
+		}
+	}
+
+	ids[*n_ids] = id;
+
+	return (uint16_t)(*n_ids)++;
+}
+
+static file_res
+read_list(const char* path, cpu_set_t* mask)
+{
+	char buf[MAX_CPU_LIST_SIZE];
+	size_t limit = sizeof(buf);
+	file_res res = read_file(path, buf, &limit);
+
+	if (res != FILE_RES_OK) {
+		return res;
+	}
+
+	buf[limit - 1] = '\0';
+
+	if (! cpu_list_from_string(buf, mask)) {
+		printf("ERROR: invalid list '%s' in %s\n", buf, path);
+		return FILE_RES_ERROR;
+	}
+
 	return FILE_RES_OK;
 }
 
 static file_res
-read_index(const char* path, uint16_t* val)
+read_signed(const char* path, int64_t* val)
 {
 	char buf[100];
 	size_t limit = sizeof(buf);
@@ -187,14 +896,14 @@ read_index(const char* path, uint16_t* val)
 	buf[limit - 1] = '\0';
 
 	char* end;
-	uint64_t x = strtoul(buf, &end, 10);
+	int64_t x = strtol(buf, &end, 10);
 
-	if (*end != '\0' || x >= CPU_SETSIZE) {
-		printf("ERROR: invalid index '%s' in %s\n", buf, path);
+	if (*end != '\0' || end == buf) {
+		printf("ERROR: invalid number '%s' in %s\n", buf, path);
 		return FILE_RES_ERROR;
 	}
 
-	*val = (uint16_t)x;
+	*val = x;
 
 	return FILE_RES_OK;
 }
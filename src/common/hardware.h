@@ -28,11 +28,61 @@
 // Includes.
 //
 
+#include <sched.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 
+//==========================================================
+// Typedefs & constants.
+//
+
+// Longest CPU list, as in sysfs - every CPU listed singly, as "1023,", plus a
+// newline and a null.
+#define MAX_CPU_LIST_SIZE ((CPU_SETSIZE * 5) + 2)
+
+#define MAX_NUM_PACKAGES 64
+#define MAX_NUM_NUMA_NODES 64
+
+// Online CPUs, by OS CPU number, and how they're arranged.
+typedef struct cpu_topology_s {
+	uint32_t n_cpus;
+	uint32_t n_cores;               // physical - SMT siblings share a core
+	uint32_t n_packages;
+	uint32_t n_numa_nodes;          // 1 if the kernel has no NUMA support
+	cpu_set_t cpus;
+	uint16_t cpu_core[CPU_SETSIZE];    // 0 ... n_cores - 1
+	uint16_t cpu_package[CPU_SETSIZE]; // 0 ... n_packages - 1
+	uint16_t cpu_node[CPU_SETSIZE];    // OS NUMA node number
+	cpu_set_t package_cpus[MAX_NUM_PACKAGES];
+	uint32_t node_ids[MAX_NUM_NUMA_NODES];    // OS numbers of online nodes
+	cpu_set_t node_cpus[MAX_NUM_NUMA_NODES];  // by OS NUMA node number
+
+	// What this process may use:
+	cpu_set_t usable_cpus;          // allowed by cgroup cpuset and affinity
+	uint32_t n_usable_cpus;         // also capped by any cgroup CPU quota
+	uint32_t quota_cpus;            // cgroup CPU quota rounded up, 0 if none
+	const char* cpu_limit;          // what limits n_usable_cpus, NULL if none
+} cpu_topology;
+
+#define MAX_NUM_HW_QUEUES 1024
+
+// A block device's blk-mq hardware queue.
+typedef struct hw_queue_s {
+	cpu_set_t cpus;                 // CPUs whose io is submitted here
+	cpu_set_t irq_cpus;             // CPUs taking completions, if known
+} hw_queue;
+
+
 //==========================================================
 // Public API.
 //
 
-uint32_t num_cpus();
+const cpu_topology* cpu_topology_get();
+uint32_t usable_cpus_in(const cpu_topology* topo, const cpu_set_t* cpus);
+bool cpu_list_from_string(const char* list, cpu_set_t* mask);
+void cpu_list_to_string(const cpu_set_t* mask, char* buf, size_t size);
+int32_t device_numa_node(const char* path);
+uint32_t device_hw_queues(const char* path, hw_queue* queues,
+		uint32_t max_queues);
@@ -0,0 +1,467 @@
+/*
+ * hdr_histogram.c
+ *
+ * Copyright (c) 2020 Aerospike, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "hdr_histogram.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "histogram.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+// About 69 seconds - bigger values are counted as this, but max_ns is exact.
+#define HDR_MAX_TRACKABLE_NS (1ULL << 36)
+
+// Sharded per thread as for the legacy histogram. Only the min and max since
+// the previous hdr_histogram_take_interval_range() are kept here - that call
+// folds them into the histogram's cumulative min and max.
+typedef struct hdr_shard_s {
+	uint64_t sum_ns;
+	uint64_t interval_min_ns;
+	uint64_t interval_max_ns;
+	uint64_t* counts;
+} __attribute__((aligned(64))) hdr_shard;
+
+//------------------------------------------------
+// Layout is as in HdrHistogram, with a unit of
+// 1 nanosecond. Values below sub_count map
+// linearly to the first sub_count counts. Each
+// power of 2 above that adds a "bucket" of
+// sub_half_count counts, each count covering a
+// range twice as wide as the previous bucket's.
+//
+struct hdr_histogram_s {
+	uint32_t sub_half_magnitude;
+	uint32_t sub_half_count;
+	uint64_t sub_mask;
+	uint32_t n_counts;
+	uint32_t shard_stride;      // n_counts rounded up to whole cache lines
+	uint64_t* all_counts;
+	uint64_t min_ns;            // only touched by dumping thread
+	uint64_t max_ns;            // only touched by dumping thread
+	uint32_t n_threads;         // threads with own shard - others share one
+	hdr_shard shards[];
+};
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static uint32_t counts_index(const hdr_histogram* h, uint64_t value);
+static uint64_t highest_equivalent_value(const hdr_histogram* h,
+		uint32_t index);
+
+
+//==========================================================
+// Inlines & macros.
+//
+
+static inline void
+atomic_min(uint64_t* p, uint64_t value)
+{
+	uint64_t cur = __atomic_load_n(p, __ATOMIC_RELAXED);
+
+	while (value < cur && ! __atomic_compare_exchange_n(p, &cur, value, true,
+			__ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+		;
+	}
+}
+
+static inline void
+atomic_max(uint64_t* p, uint64_t value)
+{
+	uint64_t cur = __atomic_load_n(p, __ATOMIC_RELAXED);
+
+	while (value > cur && ! __atomic_compare_exchange_n(p, &cur, value, true,
+			__ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+		;
+	}
+}
+
+// Add without a locked instruction - only for values one thread writes.
+static inline void
+single_writer_add(uint64_t* p, uint64_t value)
+{
+	__atomic_store_n(p, __atomic_load_n(p, __ATOMIC_RELAXED) + value,
+			__ATOMIC_RELAXED);
+}
+
+
+//==========================================================
+// Public API.
+//
+
+//------------------------------------------------
+// Create a log-linear histogram with the given
+// number of significant digits, 1 to 3. Shards
+// are as for histogram_create().
+//
+hdr_histogram*
+hdr_histogram_create(uint32_t significant_digits, uint32_t n_threads)
+{
+	if (significant_digits == 0 ||
+			significant_digits > MAX_HDR_SIGNIFICANT_DIGITS) {
+		printf("ERROR: creating hdr histogram (significant digits %u)\n",
+				significant_digits);
+		return NULL;
+	}
+
+	uint32_t n_shards = n_threads + 1;
+	void* pv;
+
+	if (posix_memalign(&pv, __alignof__(hdr_histogram),
+			sizeof(hdr_histogram) + (n_shards * sizeof(hdr_shard))) != 0) {
+		printf("ERROR: creating hdr histogram (posix_memalign)\n");
+		return NULL;
+	}
+
+	hdr_histogram* h = (hdr_histogram*)pv;
+
+	// Smallest power of 2 count for which consecutive values still differ in
+	// the last significant digit.
+	uint64_t single_unit_range = 2;
+
+	for (uint32_t d = 0; d < significant_digits; d++) {
+		single_unit_range *= 10;
+	}
+
+	uint32_t sub_magnitude = 0;
+
+	while ((1ULL << sub_magnitude) < single_unit_range) {
+		sub_magnitude++;
+	}
+
+	h->sub_half_magnitude = sub_magnitude - 1;
+	h->sub_half_count = 1 << h->sub_half_magnitude;
+	h->sub_mask = (1ULL << sub_magnitude) - 1;
+
+	uint32_t n_buckets = 1;
+
+	for (uint64_t untrackable = 1ULL << sub_magnitude;
+			untrackable <= HDR_MAX_TRACKABLE_NS; untrackable <<= 1) {
+		n_buckets++;
+	}
+
+	h->n_counts = (n_buckets + 1) * h->sub_half_count;
+	h->shard_stride = (h->n_counts + 7) & ~7U;
+
+	// Large, so calloc() maps fresh zero pages - those of shards no thread
+	// uses are never touched.
+	if ((h->all_counts = calloc(n_shards,
+			h->shard_stride * sizeof(uint64_t))) == NULL) {
+		printf("ERROR: creating hdr histogram counts (calloc)\n");
+		free(h);
+		return NULL;
+	}
+
+	h->min_ns = UINT64_MAX;
+	h->max_ns = 0;
+	h->n_threads = n_threads;
+
+	for (uint32_t s = 0; s < n_shards; s++) {
+		hdr_shard* shard = &h->shards[s];
+
+		shard->sum_ns = 0;
+		shard->interval_min_ns = UINT64_MAX;
+		shard->interval_max_ns = 0;
+		shard->counts = h->all_counts + (s * h->shard_stride);
+	}
+
+	return h;
+}
+
+//------------------------------------------------
+// Destroy a log-linear histogram.
+//
+void
+hdr_histogram_destroy(hdr_histogram* h)
+{
+	if (h != NULL) {
+		free(h->all_counts);
+		free(h);
+	}
+}
+
+//------------------------------------------------
+// Insert a time interval data point, specified in
+// nanoseconds.
+//
+void
+hdr_histogram_insert_data_point(hdr_histogram* h, uint64_t delta_ns)
+{
+	uint32_t thread_id = histogram_thread_id();
+	uint64_t value = delta_ns > HDR_MAX_TRACKABLE_NS ?
+			HDR_MAX_TRACKABLE_NS : delta_ns;
+	uint32_t index = counts_index(h, value);
+
+	if (thread_id >= h->n_threads) {
+		hdr_shard* shard = &h->shards[h->n_threads];
+
+		__atomic_fetch_add(&shard->counts[index], 1, __ATOMIC_RELAXED);
+		__atomic_fetch_add(&shard->sum_ns, delta_ns, __ATOMIC_RELAXED);
+
+		atomic_min(&shard->interval_min_ns, delta_ns);
+		atomic_max(&shard->interval_max_ns, delta_ns);
+
+		return;
+	}
+
+	// Only this thread writes its shard - no need for atomic adds. The
+	// dumping thread may reset min and max in between, but then this point
+	// is already counted in the interval it ends.
+	hdr_shard* shard = &h->shards[thread_id];
+
+	single_writer_add(&shard->counts[index], 1);
+	single_writer_add(&shard->sum_ns, delta_ns);
+
+	if (delta_ns < __atomic_load_n(&shard->interval_min_ns, __ATOMIC_RELAXED)) {
+		__atomic_store_n(&shard->interval_min_ns, delta_ns, __ATOMIC_RELAXED);
+	}
+
+	if (delta_ns > __atomic_load_n(&shard->interval_max_ns, __ATOMIC_RELAXED)) {
+		__atomic_store_n(&shard->interval_max_ns, delta_ns, __ATOMIC_RELAXED);
+	}
+}
+
+//------------------------------------------------
+// Merge all shards. Caller must free the result.
+//
+hdr_snapshot*
+hdr_histogram_snapshot(const hdr_histogram* h)
+{
+	hdr_snapshot* snap = calloc(1, sizeof(hdr_snapshot) +
+			(h->n_counts * sizeof(uint64_t)));
+
+	if (snap == NULL) {
+		printf("ERROR: hdr histogram snapshot (calloc)\n");
+		return NULL;
+	}
+
+	snap->n_counts = h->n_counts;
+	snap->min_ns = h->min_ns;
+	snap->max_ns = h->max_ns;
+
+	for (uint32_t s = 0; s <= h->n_threads; s++) {
+		const hdr_shard* shard = &h->shards[s];
+
+		for (uint32_t i = 0; i < h->n_counts; i++) {
+			uint64_t count = __atomic_load_n(&shard->counts[i],
+					__ATOMIC_RELAXED);
+
+			snap->counts[i] += count;
+			snap->count += count;
+		}
+
+		uint64_t min_ns = __atomic_load_n(&shard->interval_min_ns,
+				__ATOMIC_RELAXED);
+		uint64_t max_ns = __atomic_load_n(&shard->interval_max_ns,
+				__ATOMIC_RELAXED);
+
+		if (min_ns < snap->min_ns) {
+			snap->min_ns = min_ns;
+		}
+
+		if (max_ns > snap->max_ns) {
+			snap->max_ns = max_ns;
+		}
+
+		snap->sum_ns += __atomic_load_n(&shard->sum_ns, __ATOMIC_RELAXED);
+	}
+
+	if (snap->count == 0 || snap->min_ns == UINT64_MAX) {
+		snap->min_ns = 0;
+	}
+
+	return snap;
+}
+
+//------------------------------------------------
+// Get exact min and max since the previous call
+// (or since creation), and start a new interval.
+// Both are 0 if there were no data points. Only
+// call from the dumping thread.
+//
+void
+hdr_histogram_take_interval_range(hdr_histogram* h, uint64_t* min_ns,
+		uint64_t* max_ns)
+{
+	*min_ns = UINT64_MAX;
+	*max_ns = 0;
+
+	for (uint32_t s = 0; s <= h->n_threads; s++) {
+		hdr_shard* shard = &h->shards[s];
+		uint64_t shard_min_ns = __atomic_exchange_n(&shard->interval_min_ns,
+				UINT64_MAX, __ATOMIC_RELAXED);
+		uint64_t shard_max_ns = __atomic_exchange_n(&shard->interval_max_ns, 0,
+				__ATOMIC_RELAXED);
+
+		if (shard_min_ns < *min_ns) {
+			*min_ns = shard_min_ns;
+		}
+
+		if (shard_max_ns > *max_ns) {
+			*max_ns = shard_max_ns;
+		}
+	}
+
+	if (*min_ns < h->min_ns) {
+		h->min_ns = *min_ns;
+	}
+
+	if (*max_ns > h->max_ns) {
+		h->max_ns = *max_ns;
+	}
+
+	if (*min_ns == UINT64_MAX) {
+		*min_ns = 0;
+	}
+}
+
+//------------------------------------------------
+// Get the difference between a snapshot and an
+// earlier one (or a copy, if prev is NULL). The
+// result's min_ns and max_ns are not known, and
+// are left 0. Caller must free the result.
+//
+hdr_snapshot*
+hdr_snapshot_delta(const hdr_snapshot* snap, const hdr_snapshot* prev)
+{
+	size_t size = sizeof(hdr_snapshot) + (snap->n_counts * sizeof(uint64_t));
+	hdr_snapshot* delta = malloc(size);
+
+	if (delta == NULL) {
+		printf("ERROR: hdr histogram snapshot delta (malloc)\n");
+		return NULL;
+	}
+
+	memcpy(delta, snap, size);
+	delta->min_ns = 0;
+	delta->max_ns = 0;
+
+	if (prev != NULL) {
+		delta->count -= prev->count;
+		delta->sum_ns -= prev->sum_ns;
+
+		for (uint32_t i = 0; i < delta->n_counts; i++) {
+			delta->counts[i] -= prev->counts[i];
+		}
+	}
+
+	return delta;
+}
+
+//------------------------------------------------
+// Get values at several percentiles in one pass.
+// The percentiles must be in ascending order. A
+// value is reported as the top of its count's
+// range, but never more than max_ns if that is
+// known (non-zero). Values are 0 if the snapshot
+// is empty.
+//
+void
+hdr_snapshot_percentiles(const hdr_histogram* h, const hdr_snapshot* snap,
+		const double* pcts, uint64_t* values_ns, uint32_t n_pcts)
+{
+	uint64_t total = 0;
+	uint32_t i = 0;
+
+	for (uint32_t p = 0; p < n_pcts; p++) {
+		if (snap->count == 0) {
+			values_ns[p] = 0;
+			continue;
+		}
+
+		// Rank of the data point at this percentile, counting from 1.
+		double exact_rank = pcts[p] / 100.0 * (double)snap->count;
+		uint64_t rank = (uint64_t)exact_rank;
+
+		if ((double)rank < exact_rank || rank == 0) {
+			rank++;
+		}
+
+		while (i < snap->n_counts && total + snap->counts[i] < rank) {
+			total += snap->counts[i++];
+		}
+
+		if (i == snap->n_counts) { // only if counts changed during snapshot
+			i--;
+		}
+
+		values_ns[p] = highest_equivalent_value(h, i);
+
+		if (snap->max_ns != 0 && values_ns[p] > snap->max_ns) {
+			values_ns[p] = snap->max_ns;
+		}
+	}
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+//------------------------------------------------
+// Get the index in the counts array for a value.
+//
+static uint32_t
+counts_index(const hdr_histogram* h, uint64_t value)
+{
+	// Position of most significant bit, at least that of sub_mask.
+	uint32_t pow2_ceiling = 64 - (uint32_t)__builtin_clzll(value | h->sub_mask);
+	uint32_t bucket = pow2_ceiling - (h->sub_half_magnitude + 1);
+	uint32_t sub_bucket = (uint32_t)(value >> bucket);
+
+	return ((bucket + 1) << h->sub_half_magnitude) +
+			(sub_bucket - h->sub_half_count);
+}
+
+//------------------------------------------------
+// Get the largest value that maps to an index in
+// the counts array.
+//
+static uint64_t
+highest_equivalent_value(const hdr_histogram* h, uint32_t index)
+{
+	int32_t bucket = (int32_t)(index >> h->sub_half_magnitude) - 1;
+	uint64_t sub_bucket = (index & (h->sub_half_count - 1)) + h->sub_half_count;
+
+	if (bucket < 0) {
+		bucket = 0;
+		sub_bucket -= h->sub_half_count;
+	}
+
+	return ((sub_bucket + 1) << bucket) - 1;
+}
@@ -0,0 +1,70 @@
+/*
+ * hdr_histogram.h
+ *
+ * Copyright (c) 2020 Aerospike, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <stdint.h>
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+#define MAX_HDR_SIGNIFICANT_DIGITS 3
+
+// Log-linear histogram - value precision is kept to the configured number of
+// significant (decimal) digits, over the whole trackable range.
+typedef struct hdr_histogram_s hdr_histogram;
+
+// Merged counts of all shards, at one point in time, or the difference
+// between two such points.
+typedef struct hdr_snapshot_s {
+	uint64_t count;
+	uint64_t min_ns;        // exact - 0 if count is 0
+	uint64_t max_ns;        // exact
+	uint64_t sum_ns;        // exact
+	uint32_t n_counts;
+	uint64_t counts[];
+} hdr_snapshot;
+
+
+//==========================================================
+// Public API.
+//
+
+hdr_histogram* hdr_histogram_create(uint32_t significant_digits,
+		uint32_t n_threads);
+void hdr_histogram_destroy(hdr_histogram* h);
+void hdr_histogram_insert_data_point(hdr_histogram* h, uint64_t delta_ns);
+hdr_snapshot* hdr_histogram_snapshot(const hdr_histogram* h);
+void hdr_histogram_take_interval_range(hdr_histogram* h, uint64_t* min_ns,
+		uint64_t* max_ns);
+hdr_snapshot* hdr_snapshot_delta(const hdr_snapshot* snap,
+		const hdr_snapshot* prev);
+void hdr_snapshot_percentiles(const hdr_histogram* h, const hdr_snapshot* snap,
+		const double* pcts, uint64_t* values_ns, uint32_t n_pcts);
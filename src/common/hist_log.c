@@ -0,0 +1,179 @@
+/*
+ * hist_log.c
+ *
+ * Copyright (c) 2020 Aerospike, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "hist_log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "trace.h"
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static bool check_header(const hist_log_header* header, size_t size);
+
+
+//==========================================================
+// Public API.
+//
+
+//------------------------------------------------
+// Map a binary interval log read-only. Records
+// still being written (if the run is ongoing)
+// are not included.
+//
+bool
+hist_log_map(hist_log* log, const char* path)
+{
+	int fd = open(path, O_RDONLY);
+
+	if (fd == -1) {
+		printf("ERROR: couldn't open %s: %d '%s'\n", path, errno,
+				act_strerror(errno));
+		return false;
+	}
+
+	struct stat st;
+
+	if (fstat(fd, &st) != 0) {
+		printf("ERROR: couldn't stat %s: %d '%s'\n", path, errno,
+				act_strerror(errno));
+		close(fd);
+		return false;
+	}
+
+	size_t size = (size_t)st.st_size;
+
+	if (size < sizeof(hist_log_header)) {
+		printf("ERROR: %s has no header\n", path);
+		close(fd);
+		return false;
+	}
+
+	void* base = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+
+	close(fd);
+
+	if (base == MAP_FAILED) {
+		printf("ERROR: couldn't map %s: %d '%s'\n", path, errno,
+				act_strerror(errno));
+		return false;
+	}
+
+	const hist_log_header* header = (const hist_log_header*)base;
+
+	if (! check_header(header, size)) {
+		printf("ERROR: %s is not a valid binary interval log\n", path);
+		munmap(base, size);
+		return false;
+	}
+
+	const uint8_t* p = (const uint8_t*)base + sizeof(hist_log_header);
+
+	log->header = header;
+	log->entries = (const hist_log_entry*)p;
+	log->config = (const char*)
+			(p + (header->n_histograms * sizeof(hist_log_entry)));
+	log->records = (const uint8_t*)base + header->data_offset;
+	log->n_records = (size - header->data_offset) / header->record_size;
+	log->size = size;
+
+	return true;
+}
+
+void
+hist_log_unmap(hist_log* log)
+{
+	munmap((void*)log->header, log->size);
+	log->header = NULL;
+}
+
+//------------------------------------------------
+// Index of the first record reported at or after
+// the specified time since the start of the run,
+// or n_records if there is none.
+//
+uint64_t
+hist_log_find(const hist_log* log, uint64_t report_us)
+{
+	uint64_t lo = 0;
+	uint64_t hi = log->n_records;
+
+	while (lo < hi) {
+		uint64_t mid = lo + ((hi - lo) / 2);
+
+		if (hist_log_record_at(log, mid)->report_us < report_us) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+static bool
+check_header(const hist_log_header* header, size_t size)
+{
+	if (memcmp(header->magic, HIST_LOG_MAGIC, sizeof(header->magic)) != 0 ||
+			header->version != HIST_LOG_VERSION ||
+			header->n_histograms == 0 || header->n_buckets == 0 ||
+			header->config_size == 0 || header->config_size % 8 != 0 ||
+			memchr(header->act_version, '\0', HIST_LOG_TITLE_SIZE) == NULL ||
+			memchr(header->title, '\0', HIST_LOG_TITLE_SIZE) == NULL) {
+		return false;
+	}
+
+	uint64_t data_offset = sizeof(hist_log_header) +
+			((uint64_t)header->n_histograms * sizeof(hist_log_entry)) +
+			header->config_size;
+	const char* config = (const char*)header + data_offset -
+			header->config_size;
+
+	return header->data_offset == data_offset && data_offset <= size &&
+			header->record_size == hist_log_record_size(header->n_histograms,
+					header->n_buckets) &&
+			memchr(config, '\0', header->config_size) != NULL;
+}
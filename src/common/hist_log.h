@@ -0,0 +1,127 @@
+/*
+ * hist_log.h
+ *
+ * Copyright (c) 2020 Aerospike, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+// Layout of a binary interval log. All fields are native-endian, and all
+// sections are 8-byte aligned, so a mapped file can be used in place:
+//
+//		header
+//		entry for each histogram, in dump order
+//		config file text, null-terminated, zero-padded
+//		record for each report interval
+//
+// Records are all record_size bytes, starting at data_offset, so the record
+// for any report time is found without reading the ones before it. A record
+// holds each histogram's bucket counts added since the previous record.
+
+#define HIST_LOG_MAGIC "ACT-HLOG"
+#define HIST_LOG_VERSION 1
+#define HIST_LOG_NAME_SIZE 136 // fits "<device name>-writes"
+#define HIST_LOG_TITLE_SIZE 16
+
+typedef struct hist_log_header_s {
+	char magic[8];
+	uint32_t version;
+	uint32_t n_histograms;
+	uint32_t n_buckets;
+	uint32_t config_size;       // includes padding
+	uint64_t data_offset;
+	uint64_t record_size;
+	uint64_t report_interval_us;
+	uint64_t open_wall_us;      // when logging started
+	char act_version[HIST_LOG_TITLE_SIZE];
+	char title[HIST_LOG_TITLE_SIZE]; // "ACT-STORAGE" or "ACT-INDEX"
+} hist_log_header;
+
+typedef struct hist_log_entry_s {
+	char name[HIST_LOG_NAME_SIZE];
+	uint32_t time_div;          // as in histogram - 1, 1000 or 1000000
+	uint32_t pad;
+} hist_log_entry;
+
+// Deltas are 32 bits to keep records small. A bucket that gains more than
+// that in one interval carries the excess into following records.
+typedef struct hist_log_record_s {
+	uint64_t report_us;         // nominal - interval * report interval
+	uint64_t wall_us;
+	uint64_t monotonic_us;
+	uint64_t elapsed_us;        // actual time since previous record
+	uint32_t deltas[];          // n_buckets for each histogram
+} hist_log_record;
+
+// A mapped binary interval log.
+typedef struct hist_log_s {
+	const hist_log_header* header;
+	const hist_log_entry* entries;
+	const char* config;
+	const uint8_t* records;
+	uint64_t n_records;         // complete ones only
+	size_t size;
+} hist_log;
+
+
+//==========================================================
+// Public API.
+//
+
+static inline size_t
+hist_log_record_size(uint32_t n_histograms, uint32_t n_buckets)
+{
+	size_t size = sizeof(hist_log_record) +
+			(sizeof(uint32_t) * n_histograms * n_buckets);
+
+	return (size + 7) & -8UL;
+}
+
+bool hist_log_map(hist_log* log, const char* path);
+void hist_log_unmap(hist_log* log);
+uint64_t hist_log_find(const hist_log* log, uint64_t report_us);
+
+static inline const hist_log_record*
+hist_log_record_at(const hist_log* log, uint64_t ix)
+{
+	return (const hist_log_record*)
+			(log->records + (ix * log->header->record_size));
+}
+
+// Deltas for histogram h in record r.
+static inline const uint32_t*
+hist_log_deltas(const hist_log* log, const hist_log_record* r, uint32_t h)
+{
+	return r->deltas + ((size_t)h * log->header->n_buckets);
+}
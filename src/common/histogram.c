@@ -35,6 +35,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "interval_log.h"
+
 
 //==========================================================
 // Typedefs & constants.
@@ -76,28 +78,50 @@ static const char BYTE_MSB[] = {
 // Forward declarations.
 //
 
+static void dump_hdr_stats(histogram* h);
+static void print_hdr_line(const histogram* h, const char* label,
+		const hdr_snapshot* snap);
 static int msb(uint64_t n);
 
 
+//==========================================================
+// Globals.
+//
+
+static uint32_t g_n_threads;
+
+static __thread uint32_t tl_thread_id = (uint32_t)-1;
+
+
 //==========================================================
 // Public API.
 //
 
 //------------------------------------------------
-// Create a histogram. There's no destroy(), but
-// you can just free the histogram.
+// Create a histogram. Each of the first n_threads
+// inserting threads (by histogram_thread_id())
+// gets a shard to itself, any others share an
+// extra shard.
 //
 histogram*
-histogram_create(histogram_scale scale)
+histogram_create(histogram_scale scale, uint32_t n_threads)
 {
-	histogram* h = malloc(sizeof(histogram));
+	size_t shards_size = (n_threads + 1) * sizeof(histogram_shard);
+	void* pv;
 
-	if (h == NULL) {
-		printf("ERROR: creating histogram (malloc)\n");
+	if (posix_memalign(&pv, __alignof__(histogram),
+			sizeof(histogram) + shards_size) != 0) {
+		printf("ERROR: creating histogram (posix_memalign)\n");
 		return NULL;
 	}
 
-	memset((void*)h->counts, 0, sizeof(h->counts));
+	histogram* h = (histogram*)pv;
+
+	h->hdr = NULL;
+	h->hdr_prev = NULL;
+	h->log_prev_total = 0;
+	h->n_threads = n_threads;
+	memset((void*)h->shards, 0, shards_size);
 
 	switch (scale) {
 	case HIST_MILLISECONDS:
@@ -106,6 +130,9 @@ histogram_create(histogram_scale scale)
 	case HIST_MICROSECONDS:
 		h->time_div = 1000;
 		break;
+	case HIST_NANOSECONDS:
+		h->time_div = 1;
+		break;
 	default:
 		printf("ERROR: creating histogram (scale parameter)\n");
 		free(h);
@@ -116,7 +143,33 @@ histogram_create(histogram_scale scale)
 }
 
 //------------------------------------------------
-// Dump a histogram to stdout.
+// Add a log-linear twin to a histogram. All data
+// points inserted from then on are also inserted
+// in the twin, and dumps add lines of its stats.
+//
+bool
+histogram_add_hdr(histogram* h, uint32_t significant_digits)
+{
+	return (h->hdr = hdr_histogram_create(significant_digits,
+			h->n_threads)) != NULL;
+}
+
+//------------------------------------------------
+// Destroy a histogram, and its twin if any.
+//
+void
+histogram_destroy(histogram* h)
+{
+	if (h != NULL) {
+		hdr_histogram_destroy(h->hdr);
+		free(h->hdr_prev);
+		free(h);
+	}
+}
+
+//------------------------------------------------
+// Dump a histogram to stdout, merging all shards.
+// Also adds it to the interval log, if open.
 //
 // Note - DO NOT change the output format in this
 // method - act_latency.py assumes this format.
@@ -124,14 +177,20 @@ histogram_create(histogram_scale scale)
 void
 histogram_dump(histogram* h, const char* tag)
 {
-	uint64_t counts[N_BUCKETS];
+	uint64_t counts[N_BUCKETS] = { 0 };
 	uint32_t i = N_BUCKETS;
 	uint32_t j = 0;
 	uint64_t total = 0;
 
-	for (uint32_t b = 0; b < N_BUCKETS; b++) {
-		counts[b] = __atomic_load_n(&h->counts[b], __ATOMIC_RELAXED);
+	for (uint32_t s = 0; s <= h->n_threads; s++) {
+		const uint64_t* shard_counts = h->shards[s].counts;
 
+		for (uint32_t b = 0; b < N_BUCKETS; b++) {
+			counts[b] += __atomic_load_n(&shard_counts[b], __ATOMIC_RELAXED);
+		}
+	}
+
+	for (uint32_t b = 0; b < N_BUCKETS; b++) {
 		if (counts[b] != 0) {
 			if (i > b) {
 				i = b;
@@ -169,6 +228,12 @@ histogram_dump(histogram* h, const char* tag)
 	if (pos > 0) {
 		printf("%s\n", buf);
 	}
+
+	if (h->hdr != NULL) {
+		dump_hdr_stats(h);
+	}
+
+	interval_log_histogram(h, tag, counts, total);
 }
 
 //------------------------------------------------
@@ -197,6 +262,8 @@ histogram_dump(histogram* h, const char* tag)
 //		4		8 to 16 (more exactly, 15.999)
 //		etc.
 //
+// or the same in nanoseconds (exact ranges).
+//
 void
 histogram_insert_data_point(histogram* h, uint64_t delta_ns)
 {
@@ -207,7 +274,37 @@ histogram_insert_data_point(histogram* h, uint64_t delta_ns)
 		bucket = msb(delta_t);
 	}
 
-	__atomic_fetch_add(&h->counts[bucket], 1, __ATOMIC_RELAXED);
+	uint32_t thread_id = histogram_thread_id();
+
+	if (thread_id < h->n_threads) {
+		// Only this thread writes its shard - no need for an atomic add.
+		uint64_t* count = &h->shards[thread_id].counts[bucket];
+
+		__atomic_store_n(count, __atomic_load_n(count, __ATOMIC_RELAXED) + 1,
+				__ATOMIC_RELAXED);
+	}
+	else {
+		__atomic_fetch_add(&h->shards[h->n_threads].counts[bucket], 1,
+				__ATOMIC_RELAXED);
+	}
+
+	if (h->hdr != NULL) {
+		hdr_histogram_insert_data_point(h->hdr, delta_ns);
+	}
+}
+
+//------------------------------------------------
+// Get the calling thread's id for choosing shards,
+// assigned sequentially on the thread's first call.
+//
+uint32_t
+histogram_thread_id()
+{
+	if (tl_thread_id == (uint32_t)-1) {
+		tl_thread_id = __atomic_fetch_add(&g_n_threads, 1, __ATOMIC_RELAXED);
+	}
+
+	return tl_thread_id;
 }
 
 
@@ -215,6 +312,79 @@ histogram_insert_data_point(histogram* h, uint64_t delta_ns)
 // Local helpers.
 //
 
+//------------------------------------------------
+// Print stats from a histogram's log-linear twin,
+// for the interval since the previous dump, and
+// cumulative since the start.
+//
+static void
+dump_hdr_stats(histogram* h)
+{
+	uint64_t interval_min_ns;
+	uint64_t interval_max_ns;
+
+	// Range first - so any point in it is also in the snapshot, and the
+	// interval's bounds never exceed the cumulative ones.
+	hdr_histogram_take_interval_range(h->hdr, &interval_min_ns,
+			&interval_max_ns);
+
+	hdr_snapshot* snap = hdr_histogram_snapshot(h->hdr);
+
+	if (snap == NULL) {
+		return;
+	}
+
+	hdr_snapshot* delta = hdr_snapshot_delta(snap, h->hdr_prev);
+
+	if (delta != NULL) {
+		if (delta->count != 0) {
+			delta->min_ns = interval_min_ns < snap->min_ns ?
+					snap->min_ns : interval_min_ns;
+			delta->max_ns = interval_max_ns > snap->max_ns ?
+					snap->max_ns : interval_max_ns;
+		}
+
+		print_hdr_line(h, "interval", delta);
+		free(delta);
+	}
+
+	print_hdr_line(h, "cumulative", snap);
+
+	free(h->hdr_prev);
+	h->hdr_prev = snap;
+}
+
+//------------------------------------------------
+// Print exact min, mean and max, and percentiles.
+// The line starts with a space so act_latency.py
+// never takes it for a histogram.
+//
+static void
+print_hdr_line(const histogram* h, const char* label, const hdr_snapshot* snap)
+{
+	static const double pcts[] = { 50.0, 90.0, 99.0, 99.9, 99.99 };
+	static const char* pct_tags[] = { "p50", "p90", "p99", "p99.9", "p99.99" };
+	static const uint32_t n_pcts = sizeof(pcts) / sizeof(pcts[0]);
+
+	uint64_t values_ns[n_pcts];
+
+	hdr_snapshot_percentiles(h->hdr, snap, pcts, values_ns, n_pcts);
+
+	double div = (double)h->time_div;
+	double mean_ns = snap->count == 0 ?
+			0.0 : (double)snap->sum_ns / (double)snap->count;
+
+	printf(" %s: min %.3lf mean %.3lf", label, (double)snap->min_ns / div,
+			mean_ns / div);
+
+	for (uint32_t p = 0; p < n_pcts; p++) {
+		printf(" %s %.3lf", pct_tags[p], (double)values_ns[p] / div);
+	}
+
+	printf(" max %.3lf %s\n", (double)snap->max_ns / div,
+			h->time_div == 1 ? "ns" : (h->time_div == 1000 ? "us" : "ms"));
+}
+
 //------------------------------------------------
 // Returns the position of the most significant
 // bit of n. Positions are 1 ... 64 from low to
@@ -249,3 +419,4 @@ msb(uint64_t n)
 	printf("ERROR: msb calculation\n");
 	return -1;
 }
+
@@ -28,8 +28,11 @@
 // Includes.
 //
 
+#include <stdbool.h>
 #include <stdint.h>
 
+#include "hdr_histogram.h"
+
 
 //==========================================================
 // Typedefs & constants.
@@ -40,12 +43,22 @@
 typedef enum {
 	HIST_MILLISECONDS,
 	HIST_MICROSECONDS,
+	HIST_NANOSECONDS,
 	HIST_SCALE_MAX_PLUS_1
 } histogram_scale;
 
+// Cache line aligned, so threads don't contend with each other's shards.
+typedef struct histogram_shard_s {
+	uint64_t counts[N_BUCKETS];
+} __attribute__((aligned(64))) histogram_shard;
+
 typedef struct histogram_s {
 	uint32_t time_div;
-	uint64_t counts[N_BUCKETS];
+	hdr_histogram* hdr;     // optional log-linear twin
+	hdr_snapshot* hdr_prev; // twin's state at previous dump
+	uint64_t log_prev_total; // total at previous interval log record
+	uint32_t n_threads;     // threads with own shard - others share one more
+	histogram_shard shards[];
 } histogram;
 
 
@@ -53,6 +66,9 @@ typedef struct histogram_s {
 // Public API.
 //
 
-histogram* histogram_create(histogram_scale scale);
+histogram* histogram_create(histogram_scale scale, uint32_t n_threads);
+bool histogram_add_hdr(histogram* h, uint32_t significant_digits);
+void histogram_destroy(histogram* h);
 void histogram_dump(histogram* h, const char* tag);
 void histogram_insert_data_point(histogram* h, uint64_t delta_ns);
+uint32_t histogram_thread_id();
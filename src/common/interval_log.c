@@ -0,0 +1,515 @@
+/*
+ * interval_log.c
+ *
+ * Copyright (c) 2020 Aerospike, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "interval_log.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "clock.h"
+#include "hist_log.h"
+#include "histogram.h"
+#include "trace.h"
+#include "version.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+static const char* const FORMAT_NAMES[] = {
+		[INTERVAL_LOG_JSON] = "json",
+		[INTERVAL_LOG_CSV] = "csv",
+		[INTERVAL_LOG_BINARY] = "binary"
+};
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static bool read_config(const char* config_path);
+static void add_binary(const histogram* h, const char* tag,
+		const uint64_t* counts);
+static void end_binary();
+static bool write_binary_header();
+static void write_name(const char* name);
+static const char* unit_name(const histogram* h);
+
+
+//==========================================================
+// Globals.
+//
+
+// Only used from the reporting thread.
+static FILE* g_file = NULL;
+static interval_log_format g_format;
+static uint64_t g_open_us;          // monotonic
+static uint64_t g_prev_us;          // monotonic, at previous interval
+static uint64_t g_interval;
+static uint64_t g_wall_us;          // current interval's timestamps ...
+static uint64_t g_now_us;
+static uint64_t g_elapsed_us;
+static uint32_t g_n_histograms;     // ... and histograms so far
+
+// Binary format only - the first interval's histograms are collected before
+// the header is written, after which the set of histograms is fixed.
+static hist_log_header g_bin_header;
+static char* g_bin_config = NULL;
+static hist_log_entry* g_bin_entries = NULL;
+static uint64_t (*g_bin_counts)[N_BUCKETS] = NULL; // as dumped
+static uint64_t (*g_bin_prev)[N_BUCKETS] = NULL;   // as of previous record
+static hist_log_record* g_bin_record = NULL;
+static bool g_bin_started;
+
+
+//==========================================================
+// Inlines & macros.
+//
+
+static inline uint64_t
+wall_clock_us()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	return ((uint64_t)ts.tv_sec * 1000000) + ((uint64_t)ts.tv_nsec / 1000);
+}
+
+
+//==========================================================
+// Public API.
+//
+
+interval_log_format
+interval_log_format_from_name(const char* name)
+{
+	for (interval_log_format f = 0; f < INTERVAL_LOG_INVALID; f++) {
+		if (strcmp(name, FORMAT_NAMES[f]) == 0) {
+			return f;
+		}
+	}
+
+	return INTERVAL_LOG_INVALID;
+}
+
+const char*
+interval_log_format_name(interval_log_format format)
+{
+	return format < INTERVAL_LOG_INVALID ? FORMAT_NAMES[format] : "invalid";
+}
+
+//------------------------------------------------
+// Start logging. Elapsed times are measured from
+// here, so open just as the run starts. The
+// binary format's header also holds the title of
+// the configuration echo, the config file's text,
+// and the report interval.
+//
+bool
+interval_log_open(const char* path, interval_log_format format,
+		const char* title, const char* config_path,
+		uint64_t report_interval_us)
+{
+	if (format == INTERVAL_LOG_BINARY) {
+		if (! read_config(config_path)) {
+			return false;
+		}
+
+		memset(&g_bin_header, 0, sizeof(g_bin_header));
+		memcpy(g_bin_header.magic, HIST_LOG_MAGIC,
+				sizeof(g_bin_header.magic));
+		g_bin_header.version = HIST_LOG_VERSION;
+		g_bin_header.n_buckets = N_BUCKETS;
+		g_bin_header.report_interval_us = report_interval_us;
+		g_bin_header.open_wall_us = wall_clock_us();
+		strncpy(g_bin_header.act_version, VERSION,
+				sizeof(g_bin_header.act_version) - 1);
+		strncpy(g_bin_header.title, title, sizeof(g_bin_header.title) - 1);
+		g_bin_started = false;
+	}
+
+	if ((g_file = fopen(path, "w")) == NULL) {
+		printf("ERROR: couldn't open interval log %s: %d '%s'\n", path,
+				errno, act_strerror(errno));
+		return false;
+	}
+
+	g_format = format;
+	g_open_us = get_monotonic_ns() / 1000;
+	g_prev_us = g_open_us;
+	g_interval = 0;
+
+	if (format == INTERVAL_LOG_CSV) {
+		fprintf(g_file, "interval,wall_time_us,monotonic_us,run_us,"
+				"elapsed_us,histogram,unit,total,ops,ops_per_sec");
+
+		for (uint32_t b = 0; b < N_BUCKETS; b++) {
+			fprintf(g_file, ",b%02u", b);
+		}
+
+		fprintf(g_file, "\n");
+	}
+
+	return true;
+}
+
+void
+interval_log_close()
+{
+	if (g_file != NULL) {
+		fclose(g_file);
+		g_file = NULL;
+	}
+
+	free(g_bin_config);
+	free(g_bin_entries);
+	free(g_bin_counts);
+	free(g_bin_prev);
+	free(g_bin_record);
+
+	g_bin_config = NULL;
+	g_bin_entries = NULL;
+	g_bin_counts = NULL;
+	g_bin_prev = NULL;
+	g_bin_record = NULL;
+}
+
+//------------------------------------------------
+// Start an interval's record - histograms dumped
+// from now until interval_log_end() are in it.
+//
+void
+interval_log_begin()
+{
+	if (g_file == NULL) {
+		return;
+	}
+
+	g_interval++;
+	g_wall_us = wall_clock_us();
+	g_now_us = get_monotonic_ns() / 1000;
+	g_elapsed_us = g_now_us - g_prev_us;
+	g_prev_us = g_now_us;
+	g_n_histograms = 0;
+
+	if (g_format == INTERVAL_LOG_JSON) {
+		fprintf(g_file, "{\"interval\":%" PRIu64 ",\"wall_time_us\":%" PRIu64
+				",\"monotonic_us\":%" PRIu64 ",\"run_us\":%" PRIu64
+				",\"elapsed_us\":%" PRIu64 ",\"histograms\":[", g_interval,
+				g_wall_us, g_now_us, g_now_us - g_open_us, g_elapsed_us);
+	}
+}
+
+//------------------------------------------------
+// Add a histogram to the interval's record. Its
+// bucket counts and total are since the start of
+// the run, as dumped - its ops and rate are for
+// the interval.
+//
+void
+interval_log_histogram(histogram* h, const char* tag, const uint64_t* counts,
+		uint64_t total)
+{
+	if (g_file == NULL) {
+		return;
+	}
+
+	if (g_format == INTERVAL_LOG_BINARY) {
+		add_binary(h, tag, counts);
+		return;
+	}
+
+	uint64_t n_ops = total - h->log_prev_total;
+	double ops_per_sec = g_elapsed_us == 0 ?
+			0.0 : (double)n_ops * 1000000 / (double)g_elapsed_us;
+
+	h->log_prev_total = total;
+
+	if (g_format == INTERVAL_LOG_JSON) {
+		fprintf(g_file, "%s{\"name\":", g_n_histograms == 0 ? "" : ",");
+		write_name(tag);
+		fprintf(g_file, ",\"unit\":\"%s\",\"total\":%" PRIu64 ",\"ops\":%"
+				PRIu64 ",\"ops_per_sec\":%.2lf,\"buckets\":[", unit_name(h),
+				total, n_ops, ops_per_sec);
+
+		for (uint32_t b = 0; b < N_BUCKETS; b++) {
+			fprintf(g_file, "%s%" PRIu64, b == 0 ? "" : ",", counts[b]);
+		}
+
+		fprintf(g_file, "]}");
+	}
+	else {
+		fprintf(g_file, "%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%"
+				PRIu64 ",", g_interval, g_wall_us, g_now_us,
+				g_now_us - g_open_us, g_elapsed_us);
+		write_name(tag);
+		fprintf(g_file, ",%s,%" PRIu64 ",%" PRIu64 ",%.2lf", unit_name(h),
+				total, n_ops, ops_per_sec);
+
+		for (uint32_t b = 0; b < N_BUCKETS; b++) {
+			fprintf(g_file, ",%" PRIu64, counts[b]);
+		}
+
+		fprintf(g_file, "\n");
+	}
+
+	g_n_histograms++;
+}
+
+//------------------------------------------------
+// Finish an interval's record. Flushed so a
+// dashboard tailing the file sees it right away.
+//
+void
+interval_log_end()
+{
+	if (g_file == NULL) {
+		return;
+	}
+
+	if (g_format == INTERVAL_LOG_JSON) {
+		fprintf(g_file, "]}\n");
+	}
+	else if (g_format == INTERVAL_LOG_BINARY) {
+		end_binary();
+
+		if (g_file == NULL) {
+			return;
+		}
+	}
+
+	fflush(g_file);
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+static bool
+read_config(const char* config_path)
+{
+	FILE* config_file = fopen(config_path, "r");
+
+	if (config_file == NULL) {
+		printf("ERROR: couldn't open config file %s errno %d '%s'\n",
+				config_path, errno, act_strerror(errno));
+		return false;
+	}
+
+	size_t size = 0;
+	size_t capacity = 4096;
+	size_t n_read;
+
+	g_bin_config = malloc(capacity);
+
+	while (g_bin_config != NULL &&
+			(n_read = fread(g_bin_config + size, 1, capacity - size - 1,
+					config_file)) != 0) {
+		size += n_read;
+
+		if (size == capacity - 1) {
+			capacity *= 2;
+			g_bin_config = realloc(g_bin_config, capacity);
+		}
+	}
+
+	fclose(config_file);
+
+	if (g_bin_config == NULL) {
+		printf("ERROR: interval log config copy (realloc)\n");
+		return false;
+	}
+
+	g_bin_config[size] = '\0';
+
+	return true;
+}
+
+// Collect a histogram - in the first interval, also add it to the header.
+static void
+add_binary(const histogram* h, const char* tag, const uint64_t* counts)
+{
+	uint32_t n = g_n_histograms;
+
+	if (! g_bin_started) {
+		size_t n_new = n + 1;
+		hist_log_entry* entries;
+		uint64_t (*bin_counts)[N_BUCKETS];
+
+		if ((entries = realloc(g_bin_entries,
+				n_new * sizeof(hist_log_entry))) != NULL) {
+			g_bin_entries = entries;
+		}
+
+		if ((bin_counts = realloc(g_bin_counts,
+				n_new * sizeof(g_bin_counts[0]))) != NULL) {
+			g_bin_counts = bin_counts;
+		}
+
+		if (entries == NULL || bin_counts == NULL) {
+			printf("ERROR: interval log histograms (realloc)\n");
+			interval_log_close();
+			return;
+		}
+
+		memset(&entries[n], 0, sizeof(hist_log_entry));
+		strncpy(entries[n].name, tag, HIST_LOG_NAME_SIZE - 1);
+		entries[n].time_div = h->time_div;
+	}
+	else if (n == g_bin_header.n_histograms ||
+			strncmp(g_bin_entries[n].name, tag, HIST_LOG_NAME_SIZE - 1) != 0) {
+		printf("ERROR: interval log histograms changed - stopping log\n");
+		interval_log_close();
+		return;
+	}
+
+	memcpy(g_bin_counts[n], counts, sizeof(g_bin_counts[0]));
+	g_n_histograms++;
+}
+
+// Write the interval's record, preceded (first time) by the header.
+static void
+end_binary()
+{
+	if (! g_bin_started) {
+		if (! write_binary_header()) {
+			interval_log_close();
+			return;
+		}
+
+		g_bin_started = true;
+	}
+	else if (g_n_histograms != g_bin_header.n_histograms) {
+		printf("ERROR: interval log histograms changed - stopping log\n");
+		interval_log_close();
+		return;
+	}
+
+	hist_log_record* r = g_bin_record;
+
+	r->report_us = g_interval * g_bin_header.report_interval_us;
+	r->wall_us = g_wall_us;
+	r->monotonic_us = g_now_us;
+	r->elapsed_us = g_elapsed_us;
+
+	uint32_t* deltas = r->deltas;
+
+	for (uint32_t n = 0; n < g_n_histograms; n++) {
+		for (uint32_t b = 0; b < N_BUCKETS; b++) {
+			uint64_t delta = g_bin_counts[n][b] - g_bin_prev[n][b];
+
+			if (delta > UINT32_MAX) {
+				delta = UINT32_MAX; // rest goes in following records
+			}
+
+			*deltas++ = (uint32_t)delta;
+			g_bin_prev[n][b] += delta;
+		}
+	}
+
+	if (fwrite(r, g_bin_header.record_size, 1, g_file) != 1) {
+		printf("ERROR: writing interval log record - stopping log\n");
+		interval_log_close();
+	}
+}
+
+static bool
+write_binary_header()
+{
+	hist_log_header* header = &g_bin_header;
+	uint32_t n_histograms = g_n_histograms;
+
+	if (n_histograms == 0) {
+		printf("ERROR: no histograms for interval log\n");
+		return false;
+	}
+
+	size_t config_len = strlen(g_bin_config) + 1;
+
+	header->n_histograms = n_histograms;
+	header->config_size = (uint32_t)((config_len + 7) & -8UL);
+	header->data_offset = sizeof(hist_log_header) +
+			(n_histograms * sizeof(hist_log_entry)) + header->config_size;
+	header->record_size = hist_log_record_size(n_histograms, N_BUCKETS);
+
+	if ((g_bin_prev = calloc(n_histograms, sizeof(g_bin_prev[0]))) == NULL ||
+			(g_bin_record = calloc(1, header->record_size)) == NULL) {
+		printf("ERROR: interval log record (calloc)\n");
+		return false;
+	}
+
+	static const char zeros[8] = { 0 };
+	size_t pad_size = header->config_size - config_len;
+
+	if (fwrite(header, sizeof(hist_log_header), 1, g_file) != 1 ||
+			fwrite(g_bin_entries, sizeof(hist_log_entry), n_histograms,
+					g_file) != n_histograms ||
+			fwrite(g_bin_config, config_len, 1, g_file) != 1 ||
+			(pad_size != 0 && fwrite(zeros, pad_size, 1, g_file) != 1)) {
+		printf("ERROR: writing interval log header\n");
+		return false;
+	}
+
+	return true;
+}
+
+// Quoted, escaping quotes (and for JSON, backslashes) - names are device paths.
+static void
+write_name(const char* name)
+{
+	fputc('"', g_file);
+
+	for (const char* at = name; *at != '\0'; at++) {
+		if (*at == '"') {
+			fputs(g_format == INTERVAL_LOG_JSON ? "\\\"" : "\"\"", g_file);
+		}
+		else if (*at == '\\' && g_format == INTERVAL_LOG_JSON) {
+			fputs("\\\\", g_file);
+		}
+		else {
+			fputc(*at, g_file);
+		}
+	}
+
+	fputc('"', g_file);
+}
+
+static const char*
+unit_name(const histogram* h)
+{
+	return h->time_div == 1 ? "ns" : (h->time_div == 1000 ? "us" : "ms");
+}
@@ -0,0 +1,63 @@
+/*
+ * interval_log.h
+ *
+ * Copyright (c) 2020 Aerospike, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "histogram.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+typedef enum {
+	INTERVAL_LOG_JSON,
+	INTERVAL_LOG_CSV,
+	INTERVAL_LOG_BINARY,
+	INTERVAL_LOG_INVALID
+} interval_log_format;
+
+
+//==========================================================
+// Public API.
+//
+
+interval_log_format interval_log_format_from_name(const char* name);
+const char* interval_log_format_name(interval_log_format format);
+
+bool interval_log_open(const char* path, interval_log_format format,
+		const char* title, const char* config_path,
+		uint64_t report_interval_us);
+void interval_log_close();
+void interval_log_begin();
+void interval_log_histogram(histogram* h, const char* tag,
+		const uint64_t* counts, uint64_t total);
+void interval_log_end();
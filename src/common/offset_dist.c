@@ -0,0 +1,247 @@
+/*
+ * offset_dist.c
+ *
+ * Copyright (c) 2020 Aerospike, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "offset_dist.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "random.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+// Zeta terms summed exactly - the rest are approximated (Euler-Maclaurin),
+// so setup is fast even for billions of offsets.
+#define ZETA_EXACT_TERMS (1024 * 1024)
+
+static const char* const TYPE_NAMES[] = {
+		[OFFSET_DIST_UNIFORM] = "uniform",
+		[OFFSET_DIST_ZIPF] = "zipf",
+		[OFFSET_DIST_HOT_SET] = "hot-set",
+		[OFFSET_DIST_EXPONENTIAL] = "exponential"
+};
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static uint64_t pick_stride(uint64_t n);
+static double zeta(uint64_t n, double theta);
+
+
+//==========================================================
+// Inlines & macros.
+//
+
+// Uniform random double in (0, 1].
+static inline double
+rand_unit()
+{
+	return (double)((rand_64() >> 11) + 1) / (double)(1ULL << 53);
+}
+
+static inline uint64_t
+gcd(uint64_t a, uint64_t b)
+{
+	while (b != 0) {
+		uint64_t t = a % b;
+
+		a = b;
+		b = t;
+	}
+
+	return a;
+}
+
+
+//==========================================================
+// Public API.
+//
+
+offset_dist_type
+offset_dist_type_from_name(const char* name)
+{
+	for (offset_dist_type t = 0; t < OFFSET_DIST_INVALID; t++) {
+		if (strcmp(name, TYPE_NAMES[t]) == 0) {
+			return t;
+		}
+	}
+
+	return OFFSET_DIST_INVALID;
+}
+
+const char*
+offset_dist_type_name(offset_dist_type type)
+{
+	return type < OFFSET_DIST_INVALID ? TYPE_NAMES[type] : "invalid";
+}
+
+//------------------------------------------------
+// Set up to pick from n offsets. Zipf setup costs
+// about a million pow() calls.
+//
+void
+offset_dist_init(offset_dist* d, uint64_t n, const offset_dist_cfg* cfg)
+{
+	memset(d, 0, sizeof(offset_dist));
+
+	d->type = cfg->type;
+	d->n = n;
+	d->stride = pick_stride(n);
+
+	switch (d->type) {
+	case OFFSET_DIST_ZIPF:
+		d->theta = cfg->zipf_theta;
+		d->zeta_n = zeta(n, d->theta);
+		d->alpha = 1.0 / (1.0 - d->theta);
+		d->eta = (1.0 - pow(2.0 / (double)n, 1.0 - d->theta)) /
+				(1.0 - (zeta(2, d->theta) / d->zeta_n));
+		d->half_pow_theta = pow(0.5, d->theta);
+		break;
+	case OFFSET_DIST_HOT_SET:
+		d->hot_n = (uint64_t)((double)n * cfg->hot_space_pct / 100);
+		d->hot_ops_pct = cfg->hot_ops_pct;
+
+		if (d->hot_n == 0) {
+			d->hot_n = 1;
+		}
+		break;
+	case OFFSET_DIST_EXPONENTIAL:
+		d->exp_mean = (double)n * cfg->exp_mean_pct / 100;
+		break;
+	default:
+		break;
+	}
+}
+
+//------------------------------------------------
+// Pick an offset index, 0 to n - 1.
+//
+uint64_t
+offset_dist_next(const offset_dist* d)
+{
+	uint64_t rank;
+
+	switch (d->type) {
+	case OFFSET_DIST_ZIPF: {
+		double u = rand_unit();
+		double uz = u * d->zeta_n;
+
+		if (uz < 1.0) {
+			rank = 0;
+		}
+		else if (uz < 1.0 + d->half_pow_theta) {
+			rank = 1;
+		}
+		else {
+			rank = (uint64_t)((double)d->n *
+					pow((d->eta * u) - d->eta + 1.0, d->alpha));
+		}
+		break;
+	}
+	case OFFSET_DIST_HOT_SET:
+		if (d->hot_n == d->n || rand_32() % 100 < d->hot_ops_pct) {
+			rank = rand_64() % d->hot_n;
+		}
+		else {
+			rank = d->hot_n + (rand_64() % (d->n - d->hot_n));
+		}
+		break;
+	case OFFSET_DIST_EXPONENTIAL:
+		rank = (uint64_t)(-log(rand_unit()) * d->exp_mean);
+		break;
+	default:
+		// Uniform - no need to permute.
+		return rand_64() % d->n;
+	}
+
+	if (rank >= d->n) {
+		rank %= d->n;
+	}
+
+	return (uint64_t)(((unsigned __int128)rank * d->stride) % d->n);
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+//------------------------------------------------
+// Pick a multiplier coprime with n, about 0.618n,
+// so consecutive ranks land far apart.
+//
+static uint64_t
+pick_stride(uint64_t n)
+{
+	if (n < 3) {
+		return 1;
+	}
+
+	uint64_t stride = (uint64_t)((double)n * 0.6180339887) | 1;
+
+	while (gcd(stride, n) != 1) {
+		stride += 2;
+	}
+
+	return stride % n;
+}
+
+//------------------------------------------------
+// Sum of 1 / i^theta for i = 1 to n.
+//
+static double
+zeta(uint64_t n, double theta)
+{
+	uint64_t n_exact = n < ZETA_EXACT_TERMS ? n : ZETA_EXACT_TERMS;
+	double sum = 0;
+
+	for (uint64_t i = 1; i <= n_exact; i++) {
+		sum += pow((double)i, -theta);
+	}
+
+	if (n_exact == n) {
+		return sum;
+	}
+
+	// Euler-Maclaurin for the terms after n_exact - integral, plus end
+	// corrections using f(x) = x^-theta and f'(x) = -theta x^(-theta - 1).
+	double a = (double)n_exact;
+	double b = (double)n;
+
+	sum += (pow(b, 1.0 - theta) - pow(a, 1.0 - theta)) / (1.0 - theta);
+	sum += (pow(b, -theta) - pow(a, -theta)) / 2;
+	sum += -theta * (pow(b, -theta - 1) - pow(a, -theta - 1)) / 12;
+
+	return sum;
+}
@@ -0,0 +1,86 @@
+/*
+ * offset_dist.h
+ *
+ * Copyright (c) 2020 Aerospike, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <stdint.h>
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+typedef enum {
+	OFFSET_DIST_UNIFORM,
+	OFFSET_DIST_ZIPF,
+	OFFSET_DIST_HOT_SET,
+	OFFSET_DIST_EXPONENTIAL,
+	OFFSET_DIST_INVALID
+} offset_dist_type;
+
+// As configured - shared by all devices.
+typedef struct offset_dist_cfg_s {
+	offset_dist_type type;
+	double zipf_theta;          // skew, 0 < theta < 1
+	uint32_t hot_ops_pct;       // % of ops in the hot set ...
+	uint32_t hot_space_pct;     // ... which is this % of the offsets
+	double exp_mean_pct;        // mean rank as % of the offsets
+} offset_dist_cfg;
+
+// Picks from n offsets per a configured distribution. Popularity rank r is
+// mapped to offset (r * stride) % n, so hot offsets are spread over the
+// device rather than packed at its start.
+typedef struct offset_dist_s {
+	offset_dist_type type;
+	uint64_t n;
+	uint64_t stride;            // coprime with n
+
+	// Zipf - Gray et al., "Quickly Generating Billion-Record Synthetic
+	// Databases", as used by YCSB.
+	double theta;
+	double zeta_n;
+	double alpha;
+	double eta;
+	double half_pow_theta;
+
+	uint64_t hot_n;
+	uint32_t hot_ops_pct;
+
+	double exp_mean;
+} offset_dist;
+
+
+//==========================================================
+// Public API.
+//
+
+offset_dist_type offset_dist_type_from_name(const char* name);
+const char* offset_dist_type_name(offset_dist_type type);
+
+void offset_dist_init(offset_dist* d, uint64_t n, const offset_dist_cfg* cfg);
+uint64_t offset_dist_next(const offset_dist* d);
@@ -0,0 +1,196 @@
+/*
+ * pacer.c
+ *
+ * Copyright (c) 2020 Aerospike, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "pacer.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sys/prctl.h>
+
+#include "clock.h"
+#include "random.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+// Spin rather than sleep when the next op is due this soon - waking from
+// sleep is typically late by some microseconds.
+#define SPIN_NS (20 * 1000)
+
+// Pareto shape - below 2, so gap variance is unbounded and traffic is bursty.
+#define PARETO_SHAPE 1.5
+
+// Longest Pareto gap, in units of the minimum gap - keeps a single lull from
+// stalling a thread for minutes.
+#define PARETO_MAX_RATIO 1000.0
+
+static const char* const ARRIVAL_NAMES[] = {
+		[ARRIVAL_UNIFORM] = "uniform",
+		[ARRIVAL_POISSON] = "poisson",
+		[ARRIVAL_PARETO] = "pareto"
+};
+
+
+//==========================================================
+// Inlines & macros.
+//
+
+static inline void
+cpu_relax()
+{
+#if defined(__x86_64__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	__asm__ volatile("yield" ::: "memory");
+#endif
+}
+
+// Uniform random double in (0, 1].
+static inline double
+rand_unit()
+{
+	return (double)((rand_64() >> 11) + 1) / (double)(1ULL << 53);
+}
+
+
+//==========================================================
+// Public API.
+//
+
+arrival_dist
+arrival_dist_from_name(const char* name)
+{
+	for (arrival_dist d = 0; d < ARRIVAL_INVALID; d++) {
+		if (strcmp(name, ARRIVAL_NAMES[d]) == 0) {
+			return d;
+		}
+	}
+
+	return ARRIVAL_INVALID;
+}
+
+const char*
+arrival_dist_name(arrival_dist dist)
+{
+	return dist < ARRIVAL_INVALID ? ARRIVAL_NAMES[dist] : "invalid";
+}
+
+//------------------------------------------------
+// Set up a pacer. Call in the thread that will
+// use it, after rand_seed_thread() - also makes
+// the thread's sleeps exact, instead of up to
+// 50 us late by default.
+//
+void
+pacer_init(pacer* p, uint64_t start_ns, double ops_per_sec,
+		arrival_dist dist)
+{
+	p->start_ns = start_ns;
+	p->period_fp = (uint64_t)
+			((double)(1000000000ULL << PACER_FP_SHIFT) / ops_per_sec);
+	p->next_fp = 0;
+	p->dist = dist;
+
+	if (p->period_fp == 0) {
+		p->period_fp = 1;
+	}
+
+	// Mean of the capped Pareto distribution with minimum 1 is
+	// (shape - max_ratio ^ (1 - shape)) / (shape - 1) - scale it to 1.
+	p->pareto_scale = (PARETO_SHAPE - 1) /
+			(PARETO_SHAPE - pow(PARETO_MAX_RATIO, 1 - PARETO_SHAPE));
+
+	prctl(PR_SET_TIMERSLACK, 1UL, 0, 0, 0);
+}
+
+//------------------------------------------------
+// Wait until the next op is due - sleep, then
+// spin for the last stretch. Returns the time
+// (ns), so the caller can take all ops now due.
+//
+uint64_t
+pacer_wait(const pacer* p)
+{
+	uint64_t due_ns = pacer_sched_ns(p);
+	uint64_t now_ns = get_ns();
+
+	if (now_ns + SPIN_NS < due_ns) {
+		uint64_t sleep_ns = due_ns - now_ns - SPIN_NS;
+		struct timespec ts = {
+				.tv_sec = (time_t)(sleep_ns / 1000000000),
+				.tv_nsec = (long)(sleep_ns % 1000000000)
+		};
+
+		nanosleep(&ts, NULL);
+		now_ns = get_ns();
+	}
+
+	while (now_ns < due_ns) {
+		cpu_relax();
+		now_ns = get_ns();
+	}
+
+	return now_ns;
+}
+
+//------------------------------------------------
+// Draw the gap to the next op for non-uniform
+// arrivals.
+//
+uint64_t
+pacer_random_gap_fp(const pacer* p)
+{
+	double periods;
+
+	switch (p->dist) {
+	case ARRIVAL_POISSON:
+		periods = -log(rand_unit());
+		break;
+	case ARRIVAL_PARETO:
+		periods = pow(rand_unit(), -1 / PARETO_SHAPE);
+
+		if (periods > PARETO_MAX_RATIO) {
+			periods = PARETO_MAX_RATIO;
+		}
+
+		periods *= p->pareto_scale;
+		break;
+	default:
+		periods = 1;
+		break;
+	}
+
+	double gap_fp = periods * (double)p->period_fp;
+
+	return gap_fp < (double)UINT64_MAX ? (uint64_t)gap_fp : UINT64_MAX;
+}
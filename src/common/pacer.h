@@ -0,0 +1,108 @@
+/*
+ * pacer.h
+ *
+ * Copyright (c) 2020 Aerospike, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+// Op period is fixed point - 24 fractional bits allows periods up to ~18
+// minutes, and drifts less than a nanosecond per ~16 million ops.
+#define PACER_FP_SHIFT 24
+
+// How gaps between successive ops are distributed. All have the same mean.
+typedef enum {
+	ARRIVAL_UNIFORM,    // every gap is the mean
+	ARRIVAL_POISSON,    // exponential gaps
+	ARRIVAL_PARETO,     // heavy-tailed gaps - bursts and lulls
+	ARRIVAL_INVALID
+} arrival_dist;
+
+// Schedules a thread's ops at a given rate from a start time.
+typedef struct pacer_s {
+	uint64_t start_ns;
+	uint64_t period_fp;         // mean ns per op << PACER_FP_SHIFT
+	unsigned __int128 next_fp;  // next op's offset from start_ns, same scale
+	arrival_dist dist;
+	double pareto_scale;        // minimum Pareto gap, in periods
+} pacer;
+
+
+//==========================================================
+// Public API.
+//
+
+arrival_dist arrival_dist_from_name(const char* name);
+const char* arrival_dist_name(arrival_dist dist);
+
+void pacer_init(pacer* p, uint64_t start_ns, double ops_per_sec,
+		arrival_dist dist);
+uint64_t pacer_wait(const pacer* p);
+uint64_t pacer_random_gap_fp(const pacer* p);
+
+
+//==========================================================
+// Public API - inlines.
+//
+
+// When the next op should start, if the thread were keeping up.
+static inline uint64_t
+pacer_sched_ns(const pacer* p)
+{
+	return p->start_ns + (uint64_t)(p->next_fp >> PACER_FP_SHIFT);
+}
+
+static inline bool
+pacer_is_due(const pacer* p, uint64_t now_ns)
+{
+	return pacer_sched_ns(p) <= now_ns;
+}
+
+// Hand out the next op - returns when it should start.
+static inline uint64_t
+pacer_next(pacer* p)
+{
+	uint64_t sched_ns = pacer_sched_ns(p);
+
+	p->next_fp += p->dist == ARRIVAL_UNIFORM ?
+			p->period_fp : pacer_random_gap_fp(p);
+
+	return sched_ns;
+}
+
+// How late the next op is (negative if it's not due yet).
+static inline int64_t
+pacer_lag_ns(const pacer* p, uint64_t now_ns)
+{
+	return (int64_t)(now_ns - pacer_sched_ns(p));
+}
@@ -0,0 +1,175 @@
+/*
+ * payload.c
+ *
+ * Copyright (c) 2020 Aerospike, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "payload.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "random.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+// Windows start on this boundary, so they can be used for direct io.
+#define WINDOW_ALIGN 4096
+
+// So small writes still cycle through plenty of different data.
+#define MIN_RING_SIZE (1024 * 1024)
+
+// Granularity of salting - matches rand_fill()'s compressibility interval.
+#define SALT_INTERVAL 512
+
+// Ring may be too big for one rand_fill() call.
+#define FILL_CHUNK_SIZE (1024 * 1024 * 1024)
+
+
+//==========================================================
+// Globals.
+//
+
+// Each thread doing writes has a ring of pre-generated data, split into a
+// region per op slot. A slot's writes are given successive windows of its
+// region, and each window is salted before use so no two writes look the same
+// to a dedupe engine.
+static __thread uint8_t* tl_ring;
+static __thread uint64_t tl_ring_size;
+static __thread uint64_t tl_region_size;
+static __thread uint64_t* tl_next;      // per slot, offset in its region
+static __thread bool tl_salt;
+
+
+//==========================================================
+// Public API.
+//
+
+//------------------------------------------------
+// Build the calling thread's ring, for writes of
+// up to max_size from n_slots op slots. Each slot
+// may have one write in use - async writes may
+// complete in any order, so a slot only reuses
+// windows of its own region, which are all done
+// with when it's given a new one. Call
+// rand_seed_thread() first.
+//
+bool
+payload_thread_init(uint32_t max_size, uint32_t n_slots, uint32_t rand_pct)
+{
+	uint64_t window_size =
+			((uint64_t)max_size + WINDOW_ALIGN - 1) & ~(WINDOW_ALIGN - 1);
+
+	tl_region_size = ((MIN_RING_SIZE / n_slots) + WINDOW_ALIGN - 1) &
+			~(WINDOW_ALIGN - 1);
+
+	if (tl_region_size < window_size) {
+		tl_region_size = window_size;
+	}
+
+	tl_ring_size = tl_region_size * n_slots;
+
+	void* pv;
+
+	if (posix_memalign(&pv, WINDOW_ALIGN, tl_ring_size) != 0) {
+		printf("ERROR: payload ring (posix_memalign)\n");
+		tl_ring = NULL;
+		return false;
+	}
+
+	tl_ring = (uint8_t*)pv;
+
+	if ((tl_next = calloc(n_slots, sizeof(uint64_t))) == NULL) {
+		printf("ERROR: payload ring slots (calloc)\n");
+		payload_thread_free();
+		return false;
+	}
+
+	// Nothing to salt if the data is all zeros.
+	tl_salt = rand_pct != 0;
+
+	for (uint64_t off = 0; off < tl_ring_size; off += FILL_CHUNK_SIZE) {
+		uint64_t size = tl_ring_size - off;
+
+		rand_fill(tl_ring + off,
+				size < FILL_CHUNK_SIZE ? (uint32_t)size : FILL_CHUNK_SIZE,
+				rand_pct);
+	}
+
+	return true;
+}
+
+//------------------------------------------------
+// Free the calling thread's ring.
+//
+void
+payload_thread_free()
+{
+	free(tl_ring);
+	free(tl_next);
+	tl_ring = NULL;
+	tl_next = NULL;
+}
+
+//------------------------------------------------
+// Get data for a write of 'size' bytes from op
+// slot 'slot' - the slot's previous write must be
+// done. Replaces the last word of each
+// SALT_INTERVAL, which is always in the random
+// part of rand_fill()'s output, so
+// compressibility is unchanged.
+//
+uint8_t*
+payload_next(uint32_t slot, uint32_t size)
+{
+	uint64_t window_size =
+			((uint64_t)size + WINDOW_ALIGN - 1) & ~(WINDOW_ALIGN - 1);
+	uint64_t* p_next = &tl_next[slot];
+
+	if (*p_next + window_size > tl_region_size) {
+		*p_next = 0;
+	}
+
+	uint8_t* window = tl_ring + (slot * tl_region_size) + *p_next;
+
+	*p_next += window_size;
+
+	if (tl_salt) {
+		uint64_t* p_salt = (uint64_t*)(window + SALT_INTERVAL) - 1;
+		uint64_t* p_end = (uint64_t*)(window + size);
+
+		for ( ; p_salt < p_end; p_salt += SALT_INTERVAL / sizeof(uint64_t)) {
+			*p_salt = rand_64();
+		}
+	}
+
+	return window;
+}
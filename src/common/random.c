@@ -30,8 +30,8 @@
 
 #include <stdbool.h>
 #include <stdint.h>
-#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 
@@ -42,12 +42,38 @@
 #define INTERVAL_SIZE 512
 #define WRITES_PER_INTERVAL (INTERVAL_SIZE / sizeof(uint64_t))
 
+// Fills [p_write, p_end) - n_zeros zeros then n_rands random words per
+// interval, then random words to the end.
+typedef void (*fill_fn)(uint64_t* p_write, uint64_t* p_end, uint32_t n_zeros,
+		uint32_t n_rands);
+
+// Multi-lane fill kernels use GCC vector extensions, so the same code compiles
+// to SSE2, AVX2, AVX-512 or NEON instructions.
+typedef uint64_t v2u64 __attribute__((vector_size(16)));
+
+#if defined(__x86_64__)
+typedef uint64_t v4u64 __attribute__((vector_size(32)));
+typedef uint64_t v8u64 __attribute__((vector_size(64)));
+#endif
+
 
 //==========================================================
 // Forward declarations.
 //
 
 static inline uint64_t xorshift128plus();
+static void pick_fill();
+static void fill_scalar(uint64_t* p_write, uint64_t* p_end, uint32_t n_zeros,
+		uint32_t n_rands);
+static void fill_v2(uint64_t* p_write, uint64_t* p_end, uint32_t n_zeros,
+		uint32_t n_rands);
+
+#if defined(__x86_64__)
+static void fill_v4(uint64_t* p_write, uint64_t* p_end, uint32_t n_zeros,
+		uint32_t n_rands);
+static void fill_v8(uint64_t* p_write, uint64_t* p_end, uint32_t n_zeros,
+		uint32_t n_rands);
+#endif
 
 
 //==========================================================
@@ -57,18 +83,41 @@ static inline uint64_t xorshift128plus();
 static __thread uint64_t tl_seed0;
 static __thread uint64_t tl_seed1;
 
+// Widest fill kernel this CPU supports - picked in rand_seed(), or first
+// rand_fill_name() call.
+static fill_fn g_fill = fill_scalar;
+static const char* g_fill_name = NULL;
+
 
 //==========================================================
 // Public API.
 //
 
 //------------------------------------------------
-// Seed for system rand() call.
+// Seed for system rand() call, and pick the fill
+// kernel. Call once, before starting threads.
+// Returns the fill kernel's name.
 //
-void
+const char*
 rand_seed()
 {
 	srand(time(NULL));
+
+	return rand_fill_name();
+}
+
+//------------------------------------------------
+// Get the fill kernel's name, for echoing with
+// derived configuration.
+//
+const char*
+rand_fill_name()
+{
+	if (g_fill_name == NULL) {
+		pick_fill();
+	}
+
+	return g_fill_name;
 }
 
 //------------------------------------------------
@@ -111,26 +160,12 @@ rand_fill(uint8_t* p_buffer, uint32_t size, uint32_t rand_pct)
 	uint64_t* p_end = (uint64_t*)(p_buffer + size);
 	// ... relies on size being a multiple of 8, which it will be.
 
-	if (rand_pct < 100) {
-		// Split writes per interval as specified by rand_pct. (Calculate
-		// n_zeros first so rand_pct = 1 yields n_rands = 1 instead of 0.)
-		uint32_t n_zeros = (WRITES_PER_INTERVAL * (100 - rand_pct)) / 100;
-		uint32_t n_rands = WRITES_PER_INTERVAL - n_zeros;
-
-		for (uint32_t i = size / INTERVAL_SIZE; i != 0; i--) {
-			for (uint32_t z = n_zeros; z != 0; z--) {
-				*p_write++ = 0;
-			}
-
-			for (uint32_t r = n_rands; r != 0; r--) {
-				*p_write++ = xorshift128plus();
-			}
-		}
-	}
+	// Split writes per interval as specified by rand_pct. (Calculate n_zeros
+	// first so rand_pct = 1 yields n_rands = 1 instead of 0.)
+	uint32_t n_zeros = (WRITES_PER_INTERVAL * (100 - rand_pct)) / 100;
+	uint32_t n_rands = WRITES_PER_INTERVAL - n_zeros;
 
-	while (p_write < p_end) {
-		*p_write++ = xorshift128plus();
-	}
+	g_fill(p_write, p_end, n_zeros, n_rands);
 }
 
 
@@ -138,6 +173,32 @@ rand_fill(uint8_t* p_buffer, uint32_t size, uint32_t rand_pct)
 // Local helpers.
 //
 
+static void
+pick_fill()
+{
+	g_fill_name = "scalar";
+
+#if defined(__x86_64__)
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx512f")) {
+		g_fill = fill_v8;
+		g_fill_name = "avx-512";
+	}
+	else if (__builtin_cpu_supports("avx2")) {
+		g_fill = fill_v4;
+		g_fill_name = "avx2";
+	}
+	else {
+		g_fill = fill_v2;
+		g_fill_name = "sse2";
+	}
+#elif defined(__aarch64__)
+	g_fill = fill_v2;
+	g_fill_name = "neon";
+#endif
+}
+
 //------------------------------------------------
 // One step in generating a random sequence.
 //
@@ -153,3 +214,108 @@ xorshift128plus()
 
 	return tl_seed1 + s0;
 }
+
+//------------------------------------------------
+// Fill kernels. With n_zeros 0, the whole range
+// is random. Multi-lane kernels run independent
+// xorshift128+ generators in each lane, seeded
+// from the thread's generator on every call.
+//
+static void
+fill_scalar(uint64_t* p_write, uint64_t* p_end, uint32_t n_zeros,
+		uint32_t n_rands)
+{
+	if (n_zeros != 0) {
+		uint64_t n_intervals =
+				(uint64_t)(p_end - p_write) / WRITES_PER_INTERVAL;
+
+		for (uint64_t i = n_intervals; i != 0; i--) {
+			for (uint32_t z = n_zeros; z != 0; z--) {
+				*p_write++ = 0;
+			}
+
+			for (uint32_t r = n_rands; r != 0; r--) {
+				*p_write++ = xorshift128plus();
+			}
+		}
+	}
+
+	while (p_write < p_end) {
+		*p_write++ = xorshift128plus();
+	}
+}
+
+// One xorshift128+ step in every lane, storing the results at _p. The last
+// step in a run may store fewer than all lanes.
+#define FILL_STEP(_vt, _s0, _s1, _p, _n_words) \
+	do { \
+		_vt s1_ = _s0; \
+		_vt s0_ = _s1; \
+		_s0 = s0_; \
+		s1_ ^= s1_ << 23; \
+		_s1 = s1_ ^ s0_ ^ (s1_ >> 17) ^ (s0_ >> 26); \
+		_vt r_ = _s1 + s0_; \
+		memcpy(_p, &r_, (_n_words) * sizeof(uint64_t)); \
+	} while (false)
+
+// Fill _n random words at _p, advancing _p.
+#define FILL_RUN(_vt, _s0, _s1, _p, _n) \
+	do { \
+		const uint32_t lanes_ = sizeof(_vt) / sizeof(uint64_t); \
+		uint64_t n_ = _n; \
+		for ( ; n_ >= lanes_; n_ -= lanes_, _p += lanes_) { \
+			FILL_STEP(_vt, _s0, _s1, _p, lanes_); \
+		} \
+		if (n_ != 0) { \
+			FILL_STEP(_vt, _s0, _s1, _p, n_); \
+			_p += n_; \
+		} \
+	} while (false)
+
+// Body of a multi-lane fill kernel - same logic as fill_scalar().
+#define FILL_BODY(_vt) \
+	do { \
+		_vt s0; \
+		_vt s1; \
+		for (uint32_t l = 0; l < sizeof(_vt) / sizeof(uint64_t); l++) { \
+			s0[l] = xorshift128plus(); \
+			s1[l] = xorshift128plus(); \
+		} \
+		if (n_zeros != 0) { \
+			uint64_t n_intervals = \
+					(uint64_t)(p_end - p_write) / WRITES_PER_INTERVAL; \
+			for (uint64_t i = n_intervals; i != 0; i--) { \
+				memset(p_write, 0, n_zeros * sizeof(uint64_t)); \
+				p_write += n_zeros; \
+				FILL_RUN(_vt, s0, s1, p_write, n_rands); \
+			} \
+		} \
+		FILL_RUN(_vt, s0, s1, p_write, (uint64_t)(p_end - p_write)); \
+	} while (false)
+
+static void
+fill_v2(uint64_t* p_write, uint64_t* p_end, uint32_t n_zeros,
+		uint32_t n_rands)
+{
+	FILL_BODY(v2u64);
+}
+
+#if defined(__x86_64__)
+
+__attribute__((target("avx2")))
+static void
+fill_v4(uint64_t* p_write, uint64_t* p_end, uint32_t n_zeros,
+		uint32_t n_rands)
+{
+	FILL_BODY(v4u64);
+}
+
+__attribute__((target("avx512f")))
+static void
+fill_v8(uint64_t* p_write, uint64_t* p_end, uint32_t n_zeros,
+		uint32_t n_rands)
+{
+	FILL_BODY(v8u64);
+}
+
+#endif
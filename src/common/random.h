@@ -35,7 +35,8 @@
 // Public API.
 //
 
-void rand_seed();
+const char* rand_seed();
+const char* rand_fill_name();
 void rand_seed_thread();
 uint32_t rand_32();
 uint64_t rand_64();
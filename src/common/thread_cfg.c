@@ -0,0 +1,196 @@
+/*
+ * thread_cfg.c
+ *
+ * Copyright (c) 2020 Aerospike, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "thread_cfg.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "hardware.h"
+#include "trace.h"
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static bool resolve_cpus(const thread_cfg* cfg, const cpu_set_t* place_cpus,
+		cpu_set_t* cpus);
+
+
+//==========================================================
+// Public API.
+//
+
+//------------------------------------------------
+// Create a thread placed per cfg (may be NULL)
+// and restricted to place_cpus (may be NULL) -
+// e.g. a device's NUMA node. If both apply, the
+// thread runs on their overlap.
+//
+bool
+thread_create(pthread_t* tid, void* (*run)(void*), void* arg,
+		const thread_cfg* cfg, const cpu_set_t* place_cpus)
+{
+	cpu_set_t cpus;
+
+	if (! resolve_cpus(cfg, place_cpus, &cpus)) {
+		return false;
+	}
+
+	pthread_attr_t attr;
+	int err = pthread_attr_init(&attr);
+
+	if (err != 0) {
+		printf("ERROR: pthread_attr_init errno %d '%s'\n", err,
+				act_strerror(err));
+		return false;
+	}
+
+	if (CPU_COUNT(&cpus) != 0 &&
+			(err = pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t),
+					&cpus)) != 0) {
+		printf("ERROR: setting thread affinity errno %d '%s'\n", err,
+				act_strerror(err));
+		pthread_attr_destroy(&attr);
+		return false;
+	}
+
+	if (cfg != NULL && cfg->fifo_priority != 0) {
+		struct sched_param param = {
+				.sched_priority = (int)cfg->fifo_priority
+		};
+
+		if ((err = pthread_attr_setinheritsched(&attr,
+						PTHREAD_EXPLICIT_SCHED)) != 0 ||
+				(err = pthread_attr_setschedpolicy(&attr, SCHED_FIFO)) != 0 ||
+				(err = pthread_attr_setschedparam(&attr, &param)) != 0) {
+			printf("ERROR: setting SCHED_FIFO errno %d '%s'\n", err,
+					act_strerror(err));
+			pthread_attr_destroy(&attr);
+			return false;
+		}
+	}
+
+	err = pthread_create(tid, &attr, run, arg);
+
+	pthread_attr_destroy(&attr);
+
+	if (err != 0) {
+		printf("ERROR: pthread_create errno %d '%s'\n", err,
+				act_strerror(err));
+
+		if (err == EPERM) {
+			printf("SCHED_FIFO needs root or CAP_SYS_NICE\n");
+		}
+
+		return false;
+	}
+
+	return true;
+}
+
+//------------------------------------------------
+// Place the calling thread per cfg. Call after
+// creating other threads, so they don't inherit
+// this placement.
+//
+bool
+thread_place_self(const thread_cfg* cfg)
+{
+	if (! cfg->is_pinned) {
+		return true;
+	}
+
+	int err = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t),
+			&cfg->cpus);
+
+	if (err != 0) {
+		printf("ERROR: setting thread affinity errno %d '%s'\n", err,
+				act_strerror(err));
+		return false;
+	}
+
+	return true;
+}
+
+//------------------------------------------------
+// For configuration echo.
+//
+const char*
+thread_cpus_string(const thread_cfg* cfg, char* buf, size_t size)
+{
+	if (! cfg->is_pinned) {
+		return "any";
+	}
+
+	cpu_list_to_string(&cfg->cpus, buf, size);
+
+	return buf;
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+static bool
+resolve_cpus(const thread_cfg* cfg, const cpu_set_t* place_cpus,
+		cpu_set_t* cpus)
+{
+	CPU_ZERO(cpus);
+
+	bool is_pinned = cfg != NULL && cfg->is_pinned;
+
+	if (! is_pinned) {
+		if (place_cpus != NULL) {
+			CPU_OR(cpus, cpus, place_cpus);
+		}
+
+		return true;
+	}
+
+	if (place_cpus == NULL) {
+		CPU_OR(cpus, cpus, &cfg->cpus);
+		return true;
+	}
+
+	CPU_AND(cpus, &cfg->cpus, place_cpus);
+
+	if (CPU_COUNT(cpus) == 0) {
+		printf("ERROR: configured CPUs not among device's CPUs\n");
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,59 @@
+/*
+ * thread_cfg.h
+ *
+ * Copyright (c) 2020 Aerospike, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+// Where and how a class of threads runs.
+typedef struct thread_cfg_s {
+	bool is_pinned;         // else may run on any CPU
+	cpu_set_t cpus;         // if pinned - empty if configured list was bad
+	uint32_t fifo_priority; // 0 for normal (non real-time) scheduling
+} thread_cfg;
+
+#define MAX_FIFO_PRIORITY 99
+
+
+//==========================================================
+// Public API.
+//
+
+bool thread_create(pthread_t* tid, void* (*run)(void*), void* arg,
+		const thread_cfg* cfg, const cpu_set_t* place_cpus);
+bool thread_place_self(const thread_cfg* cfg);
+const char* thread_cpus_string(const thread_cfg* cfg, char* buf, size_t size);
@@ -0,0 +1,316 @@
+/*
+ * act_histlog.c
+ *
+ * Copyright (c) 2020 Aerospike, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common/hist_log.h"
+#include "common/histogram.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+// Echoed from the header rather than the config file, which may omit them.
+static const char* const HEADER_TAGS[] = {
+		"report-interval-sec",
+		"microsecond-histograms",
+		"nanosecond-histograms"
+};
+
+#define N_HEADER_TAGS (sizeof(HEADER_TAGS) / sizeof(HEADER_TAGS[0]))
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static void usage();
+static bool parse_sec(const char* arg, uint64_t* p_us);
+static void echo_preamble(const hist_log* log, const char* path);
+static void echo_config(const char* config);
+static bool create_histograms(const hist_log* log, histogram** hists);
+static void add_record(const hist_log* log, const hist_log_record* r,
+		histogram** hists);
+
+
+//==========================================================
+// Main.
+//
+
+int
+main(int argc, char* argv[])
+{
+	uint64_t start_us = 0;
+	uint64_t end_us = UINT64_MAX;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "s:e:")) != -1) {
+		switch (opt) {
+		case 's':
+			if (! parse_sec(optarg, &start_us)) {
+				exit(-1);
+			}
+			break;
+		case 'e':
+			if (! parse_sec(optarg, &end_us)) {
+				exit(-1);
+			}
+			break;
+		default:
+			usage();
+			exit(-1);
+		}
+	}
+
+	if (optind != argc - 1) {
+		usage();
+		exit(-1);
+	}
+
+	const char* path = argv[optind];
+	hist_log log;
+
+	if (! hist_log_map(&log, path)) {
+		exit(-1);
+	}
+
+	uint32_t n_histograms = log.header->n_histograms;
+	histogram* hists[n_histograms];
+
+	if (! create_histograms(&log, hists)) {
+		exit(-1);
+	}
+
+	echo_preamble(&log, path);
+
+	// Counts are since the start of the run, so sum the skipped records.
+	uint64_t ix = hist_log_find(&log, start_us);
+
+	for (uint64_t i = 0; i < ix; i++) {
+		add_record(&log, hist_log_record_at(&log, i), hists);
+	}
+
+	for ( ; ix < log.n_records; ix++) {
+		const hist_log_record* r = hist_log_record_at(&log, ix);
+
+		if (r->report_us > end_us) {
+			break;
+		}
+
+		add_record(&log, r, hists);
+
+		printf("after %" PRIu64 " sec:\n", r->report_us / 1000000);
+
+		for (uint32_t n = 0; n < n_histograms; n++) {
+			histogram_dump(hists[n], log.entries[n].name);
+		}
+
+		printf("\n");
+	}
+
+	for (uint32_t n = 0; n < n_histograms; n++) {
+		histogram_destroy(hists[n]);
+	}
+
+	hist_log_unmap(&log);
+
+	return 0;
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+static void
+usage()
+{
+	printf("usage: act_histlog [-s start-sec] [-e end-sec] "
+			"[binary interval log]\n");
+	printf("  converts a binary interval log to ACT's text output\n");
+	printf("  -s: first report to convert, by seconds into the run\n");
+	printf("  -e: last report to convert, by seconds into the run\n");
+}
+
+static bool
+parse_sec(const char* arg, uint64_t* p_us)
+{
+	char* end;
+	uint64_t sec = strtoull(arg, &end, 10);
+
+	if (*arg == '\0' || *end != '\0' || sec > UINT64_MAX / 1000000) {
+		printf("ERROR: invalid seconds '%s'\n", arg);
+		return false;
+	}
+
+	*p_us = sec * 1000000;
+
+	return true;
+}
+
+//------------------------------------------------
+// Print the parts of ACT's output act_latency.py
+// uses, from before the first report. Only the
+// config file's own lines can be echoed - items
+// left at their defaults, and derived values,
+// are not recorded.
+//
+static void
+echo_preamble(const hist_log* log, const char* path)
+{
+	const hist_log_header* header = log->header;
+	uint32_t time_div = log->entries[0].time_div;
+
+	printf("\nACT version %s\n", header->act_version);
+	printf("Converted from binary interval log %s\n\n", path);
+
+	printf("%s CONFIGURATION\n", header->title);
+	printf("%s: %" PRIu64 "\n", HEADER_TAGS[0],
+			header->report_interval_us / 1000000);
+	printf("%s: %s\n", HEADER_TAGS[1], time_div == 1000 ? "yes" : "no");
+	printf("%s: %s\n", HEADER_TAGS[2], time_div == 1 ? "yes" : "no");
+	echo_config(log->config);
+
+	printf("\nDERIVED CONFIGURATION\n");
+	printf("not recorded in binary interval log\n");
+
+	printf("\nHISTOGRAM NAMES\n");
+
+	for (uint32_t n = 0; n < header->n_histograms; n++) {
+		printf("%s\n", log->entries[n].name);
+	}
+
+	printf("\n");
+}
+
+// Echo the config file's items, without comments and blank lines.
+static void
+echo_config(const char* config)
+{
+	while (*config != '\0') {
+		size_t line_len = strcspn(config, "\n");
+		size_t len = strcspn(config, "#\n");
+		const char* line = config;
+
+		config += line_len + (config[line_len] == '\n' ? 1 : 0);
+
+		while (len != 0 && (*line == ' ' || *line == '\t')) {
+			line++;
+			len--;
+		}
+
+		while (len != 0 && (line[len - 1] == ' ' || line[len - 1] == '\t' ||
+				line[len - 1] == '\r')) {
+			len--;
+		}
+
+		if (len == 0) {
+			continue;
+		}
+
+		bool is_header_tag = false;
+
+		for (uint32_t t = 0; t < N_HEADER_TAGS; t++) {
+			size_t tag_len = strlen(HEADER_TAGS[t]);
+
+			if (len > tag_len && strncmp(line, HEADER_TAGS[t], tag_len) == 0 &&
+					line[tag_len] == ':') {
+				is_header_tag = true;
+				break;
+			}
+		}
+
+		if (! is_header_tag) {
+			printf("%.*s\n", (int)len, line);
+		}
+	}
+}
+
+static bool
+create_histograms(const hist_log* log, histogram** hists)
+{
+	if (log->header->n_buckets != N_BUCKETS) {
+		printf("ERROR: log has %" PRIu32 " buckets per histogram, not %d\n",
+				log->header->n_buckets, N_BUCKETS);
+		return false;
+	}
+
+	for (uint32_t n = 0; n < log->header->n_histograms; n++) {
+		const hist_log_entry* entry = &log->entries[n];
+		histogram_scale scale;
+
+		switch (entry->time_div) {
+		case 1000 * 1000:
+			scale = HIST_MILLISECONDS;
+			break;
+		case 1000:
+			scale = HIST_MICROSECONDS;
+			break;
+		case 1:
+			scale = HIST_NANOSECONDS;
+			break;
+		default:
+			printf("ERROR: histogram %" PRIu32 " has invalid time unit\n", n);
+			return false;
+		}
+
+		if (memchr(entry->name, '\0', sizeof(entry->name)) == NULL) {
+			printf("ERROR: histogram %" PRIu32 " has invalid name\n", n);
+			return false;
+		}
+
+		// No threads insert - add_record() fills the one shared shard.
+		if ((hists[n] = histogram_create(scale, 0)) == NULL) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Add a record's deltas to the histograms, which then dump as ACT would have.
+static void
+add_record(const hist_log* log, const hist_log_record* r, histogram** hists)
+{
+	for (uint32_t n = 0; n < log->header->n_histograms; n++) {
+		const uint32_t* deltas = hist_log_deltas(log, r, n);
+		uint64_t* counts = hists[n]->shards[0].counts;
+
+		for (uint32_t b = 0; b < N_BUCKETS; b++) {
+			counts[b] += deltas[b];
+		}
+	}
+}
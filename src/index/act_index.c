@@ -47,13 +47,19 @@
 #include <sys/stat.h>
 #include <sys/ioctl.h>
 
+#include "common/async_io.h"
+#include "common/buf_pool.h"
 #include "common/cfg.h"
 #include "common/clock.h"
 #include "common/hardware.h"
 #include "common/histogram.h"
+#include "common/interval_log.h"
 #include "common/io.h"
+#include "common/offset_dist.h"
+#include "common/pacer.h"
 #include "common/queue.h"
 #include "common/random.h"
+#include "common/thread_cfg.h"
 #include "common/trace.h"
 #include "common/version.h"
 
@@ -67,20 +73,49 @@
 typedef struct device_s {
 	const char* name;
 	uint64_t n_io_offsets;
+	offset_dist read_dist;
 	queue* fd_q;
+	pthread_t* closed_loop_threads;
 	histogram* read_hist;
 	histogram* write_hist;
 	char read_hist_tag[MAX_DEVICE_NAME_SIZE + 1 + 5];
 	char write_hist_tag[MAX_DEVICE_NAME_SIZE + 1 + 6];
+	uint64_t n_ops;      // counted in closed-loop mode only
 } device;
 
 typedef struct trans_req_s {
 	device* dev;
 	uint64_t offset;
+	uint64_t sched_ns;
 } trans_req;
 
+typedef enum {
+	OP_READ,
+	OP_WRITE
+} op_type;
+
+// Per-thread state when using an asynchronous io engine.
+typedef struct async_thread_s {
+	async_io* aio;
+	uint32_t depth;
+	io_op* ops;
+	io_op** free_ops;
+	uint32_t n_free;
+	buf_pool pool;      // one buffer per op
+} async_thread;
+
+// Fills in an io_op's device, type, offset and write data.
+typedef void (*prep_fn)(io_op* op, void* udata);
+
 #define IO_SIZE 4096
-#define BUNDLE_SIZE 100
+
+// Most ops (or cache read and write pairs) a paced sync thread does
+// back-to-back when it has fallen behind.
+#define MAX_PACED_BATCH 100
+
+#define REAP_WAIT_US 1000
+
+#define SPLIT_RESOLUTION (1024 * 1024)
 
 
 //==========================================================
@@ -89,18 +124,43 @@ typedef struct trans_req_s {
 
 static void* run_cache_simulation(void* pv_unused);
 static void* run_service(void* pv_unused);
+static void* run_cache_simulation_async(void* pv_unused);
+static void* run_service_async(void* pv_unused);
+static void* run_closed_loop(void* pv_dev);
+static void* run_closed_loop_async(void* pv_dev);
 
 static bool discover_device(device* dev);
 static void fd_close_all(device* dev);
 static int fd_get(device* dev);
 static void fd_put(device* dev, int fd);
+static uint32_t max_reporting_threads();
 static void read_and_report(trans_req* read_req, uint8_t* buf);
-static void read_cache_and_report(uint8_t* buf);
+static void read_cache_and_report(uint8_t* buf, uint64_t sched_ns);
 static uint64_t read_from_device(device* dev, uint64_t offset, uint8_t* buf);
-static void write_cache_and_report(uint8_t* buf);
+static void report_op(op_type type, device* dev, uint64_t sched_ns,
+		uint64_t start_ns, uint64_t stop_ns);
+static void write_cache_and_report(uint8_t* buf, uint64_t sched_ns);
 static uint64_t write_to_device(device* dev, uint64_t offset,
 		const uint8_t* buf);
 
+static bool async_thread_init(async_thread* at, uint32_t depth);
+static void async_thread_destroy(async_thread* at);
+static void prep_cache_op(io_op* op, void* pv_count);
+static void prep_read(io_op* op, device* dev);
+static void prep_service_op(io_op* op, void* pv_unused);
+static void prep_write(io_op* op, device* dev);
+static void reap_and_report(async_thread* at, uint64_t timeout_us);
+static void report_async_op(io_op* op, uint64_t stop_ns);
+static void run_async_paced(async_thread* at, double ops_per_sec, prep_fn prep,
+		void* udata, const char* what);
+static bool submit_async_op(async_thread* at, prep_fn prep, void* udata,
+		uint64_t sched_ns);
+
+static void do_sync_op(io_op* op);
+static void prep_closed_loop_op(io_op* op, void* pv_dev);
+static void report_throughput(uint64_t interval_us);
+static void set_closed_loop_split();
+
 
 //==========================================================
 // Globals.
@@ -114,21 +174,28 @@ static uint64_t g_run_start_us;
 static histogram* g_read_hist;
 static histogram* g_write_hist;
 
+// Latency from intended start on each thread's schedule - if co-histograms.
+static histogram* g_co_read_hist;
+static histogram* g_co_write_hist;
+
+// Closed-loop mode op mix - threshold out of SPLIT_RESOLUTION for reads.
+static uint64_t g_closed_loop_read_split;
+
 
 //==========================================================
 // Inlines & macros.
 //
 
-static inline uint8_t*
-align_4096(const uint8_t* stack_buffer)
+static inline uint64_t
+random_io_offset(const device* dev)
 {
-	return (uint8_t*)(((uint64_t)stack_buffer + 4095) & ~4095ULL);
+	return (rand_64() % dev->n_io_offsets) * IO_SIZE;
 }
 
 static inline uint64_t
-random_io_offset(const device* dev)
+random_read_offset(const device* dev)
 {
-	return (rand_64() % dev->n_io_offsets) * IO_SIZE;
+	return offset_dist_next(&dev->read_dist) * IO_SIZE;
 }
 
 static inline uint64_t
@@ -138,6 +205,7 @@ safe_delta_ns(uint64_t start_ns, uint64_t stop_ns)
 }
 
 
+
 //==========================================================
 // Main.
 //
@@ -155,15 +223,41 @@ main(int argc, char* argv[])
 		exit(-1);
 	}
 
+	clock_init();
+
 	device devices[g_icfg.num_devices];
 
 	g_devices = devices;
 
-	histogram_scale scale =
-			g_icfg.us_histograms ? HIST_MICROSECONDS : HIST_MILLISECONDS;
+	histogram_scale scale = g_icfg.ns_histograms ? HIST_NANOSECONDS :
+			(g_icfg.us_histograms ? HIST_MICROSECONDS : HIST_MILLISECONDS);
+
+	// Histograms give each thread reporting ops a shard of its own.
+	uint32_t n_threads = max_reporting_threads();
+
+	if (! (g_read_hist = histogram_create(scale, n_threads)) ||
+		! (g_write_hist = histogram_create(scale, n_threads))) {
+		exit(-1);
+	}
+
+	if (g_icfg.co_histograms &&
+			(! (g_co_read_hist = histogram_create(scale, n_threads)) ||
+			! (g_co_write_hist = histogram_create(scale, n_threads)))) {
+		exit(-1);
+	}
+
+	uint32_t hdr_digits = g_icfg.hdr_significant_digits;
+
+	// Log-linear twins for the aggregate histograms only.
+	if (hdr_digits != 0 &&
+			(! histogram_add_hdr(g_read_hist, hdr_digits) ||
+			! histogram_add_hdr(g_write_hist, hdr_digits))) {
+		exit(-1);
+	}
 
-	if (! (g_read_hist = histogram_create(scale)) ||
-		! (g_write_hist = histogram_create(scale))) {
+	if (hdr_digits != 0 && g_icfg.co_histograms &&
+			(! histogram_add_hdr(g_co_read_hist, hdr_digits) ||
+			! histogram_add_hdr(g_co_write_hist, hdr_digits))) {
 		exit(-1);
 	}
 
@@ -174,8 +268,8 @@ main(int argc, char* argv[])
 
 		if (! (dev->fd_q = queue_create(sizeof(int))) ||
 			! discover_device(dev) ||
-			! (dev->read_hist = histogram_create(scale)) ||
-			! (dev->write_hist = histogram_create(scale))) {
+			! (dev->read_hist = histogram_create(scale, n_threads)) ||
+			! (dev->write_hist = histogram_create(scale, n_threads))) {
 			exit(-1);
 		}
 
@@ -185,19 +279,35 @@ main(int argc, char* argv[])
 
 	rand_seed();
 
+	if (g_icfg.interval_log_file[0] != '\0' &&
+			! interval_log_open(g_icfg.interval_log_file,
+					g_icfg.interval_log_format, "ACT-INDEX", argv[1],
+					g_icfg.report_interval_us)) {
+		exit(-1);
+	}
+
 	g_run_start_us = get_us();
 
 	uint64_t run_stop_us = g_run_start_us + g_icfg.run_us;
 
 	g_running = true;
 
+	bool is_async = g_icfg.io_engine != IO_ENGINE_SYNC;
+	bool is_closed_loop = g_icfg.closed_loop_qd != 0;
+
 	pthread_t cache_tids[g_icfg.cache_threads];
 	bool has_write_load = g_icfg.cache_thread_reads_and_writes_per_sec != 0;
 
-	if (has_write_load) {
+	// In closed-loop mode, closed-loop threads do all the device ops.
+	bool do_open_loop = ! is_closed_loop;
+
+	if (do_open_loop && has_write_load) {
 		for (uint32_t n = 0; n < g_icfg.cache_threads; n++) {
-			if (pthread_create(&cache_tids[n], NULL, run_cache_simulation,
-					NULL) != 0) {
+			if (! thread_create(&cache_tids[n],
+					is_async ?
+							run_cache_simulation_async :
+							run_cache_simulation,
+					NULL, &g_icfg.cache_cpus, NULL)) {
 				printf("ERROR: create cache thread\n");
 				exit(-1);
 			}
@@ -206,13 +316,49 @@ main(int argc, char* argv[])
 
 	pthread_t svc_tids[g_icfg.service_threads];
 
-	for (uint32_t k = 0; k < g_icfg.service_threads; k++) {
-		if (pthread_create(&svc_tids[k], NULL, run_service, NULL) != 0) {
+	for (uint32_t k = 0; do_open_loop && k < g_icfg.service_threads; k++) {
+		if (! thread_create(&svc_tids[k],
+				is_async ? run_service_async : run_service, NULL,
+				&g_icfg.service_cpus, NULL)) {
 			printf("ERROR: create service thread\n");
 			exit(-1);
 		}
 	}
 
+	// Async engines keep the whole queue depth in flight from one thread per
+	// device, the sync engine needs a thread per op in flight.
+	uint32_t n_closed_loop_threads = is_async ? 1 : g_icfg.closed_loop_qd;
+
+	if (is_closed_loop) {
+		set_closed_loop_split();
+
+		for (uint32_t d = 0; d < g_icfg.num_devices; d++) {
+			device* dev = &g_devices[d];
+
+			dev->closed_loop_threads =
+					malloc(n_closed_loop_threads * sizeof(pthread_t));
+
+			if (dev->closed_loop_threads == NULL) {
+				printf("ERROR: closed-loop threads (malloc)\n");
+				exit(-1);
+			}
+
+			for (uint32_t k = 0; k < n_closed_loop_threads; k++) {
+				if (! thread_create(&dev->closed_loop_threads[k],
+						is_async ? run_closed_loop_async : run_closed_loop,
+						(void*)dev, &g_icfg.closed_loop_cpus, NULL)) {
+					printf("ERROR: create closed-loop thread\n");
+					exit(-1);
+				}
+			}
+		}
+	}
+
+	// Only now, so worker threads don't inherit the reporter's placement.
+	if (! thread_place_self(&g_icfg.reporter_cpus)) {
+		exit(-1);
+	}
+
 	printf("\nHISTOGRAM NAMES\n");
 
 	printf("reads\n");
@@ -221,18 +367,27 @@ main(int argc, char* argv[])
 		printf("%s\n", g_devices[d].read_hist_tag);
 	}
 
+	if (g_icfg.co_histograms) {
+		printf("co-reads\n");
+	}
+
 	if (has_write_load) {
 		printf("writes\n");
 
 		for (uint32_t d = 0; d < g_icfg.num_devices; d++) {
 			printf("%s\n", g_devices[d].write_hist_tag);
 		}
+
+		if (g_icfg.co_histograms) {
+			printf("co-writes\n");
+		}
 	}
 
 	printf("\n");
 
 	uint64_t now_us = 0;
 	uint64_t count = 0;
+	uint64_t last_report_us = g_run_start_us;
 
 	while (g_running && (now_us = get_us()) < run_stop_us) {
 		count++;
@@ -248,6 +403,8 @@ main(int argc, char* argv[])
 		printf("after %" PRIu64 " sec:\n",
 				(count * g_icfg.report_interval_us) / 1000000);
 
+		interval_log_begin();
+
 		histogram_dump(g_read_hist, "reads");
 
 		for (uint32_t d = 0; d < g_icfg.num_devices; d++) {
@@ -255,6 +412,10 @@ main(int argc, char* argv[])
 					g_devices[d].read_hist_tag);
 		}
 
+		if (g_icfg.co_histograms) {
+			histogram_dump(g_co_read_hist, "co-reads");
+		}
+
 		if (has_write_load) {
 			histogram_dump(g_write_hist, "writes");
 
@@ -262,19 +423,34 @@ main(int argc, char* argv[])
 				histogram_dump(g_devices[d].write_hist,
 						g_devices[d].write_hist_tag);
 			}
+
+			if (g_icfg.co_histograms) {
+				histogram_dump(g_co_write_hist, "co-writes");
+			}
+		}
+
+		if (is_closed_loop) {
+			uint64_t report_us = get_us();
+
+			report_throughput(report_us - last_report_us);
+			last_report_us = report_us;
 		}
 
+		interval_log_end();
+
 		printf("\n");
 		fflush(stdout);
 	}
 
 	g_running = false;
 
-	for (uint32_t k = 0; k < g_icfg.service_threads; k++) {
+	interval_log_close();
+
+	for (uint32_t k = 0; do_open_loop && k < g_icfg.service_threads; k++) {
 		pthread_join(svc_tids[k], NULL);
 	}
 
-	if (has_write_load) {
+	if (do_open_loop && has_write_load) {
 		for (uint32_t n = 0; n < g_icfg.cache_threads; n++) {
 			pthread_join(cache_tids[n], NULL);
 		}
@@ -283,14 +459,24 @@ main(int argc, char* argv[])
 	for (uint32_t d = 0; d < g_icfg.num_devices; d++) {
 		device* dev = &g_devices[d];
 
+		if (is_closed_loop) {
+			for (uint32_t k = 0; k < n_closed_loop_threads; k++) {
+				pthread_join(dev->closed_loop_threads[k], NULL);
+			}
+
+			free(dev->closed_loop_threads);
+		}
+
 		fd_close_all(dev);
 		queue_destroy(dev->fd_q);
-		free(dev->read_hist);
-		free(dev->write_hist);
+		histogram_destroy(dev->read_hist);
+		histogram_destroy(dev->write_hist);
 	}
 
-	free(g_read_hist);
-	free(g_write_hist);
+	histogram_destroy(g_read_hist);
+	histogram_destroy(g_write_hist);
+	histogram_destroy(g_co_read_hist);
+	histogram_destroy(g_co_write_hist);
 
 	return 0;
 }
@@ -310,39 +496,44 @@ run_cache_simulation(void* pv_unused)
 {
 	rand_seed_thread();
 
-	uint8_t stack_buffer[IO_SIZE + 4096];
-	uint8_t* buf = align_4096(stack_buffer);
+	buf_pool pool;
 
-	uint64_t target_factor =
-			1000000ull * g_icfg.num_devices * g_icfg.cache_threads;
+	if (! buf_pool_init(&pool, 1, IO_SIZE)) {
+		g_running = false;
+		return NULL;
+	}
 
-	uint64_t count = 0;
+	uint8_t* buf = buf_pool_get(&pool, 0);
 
-	while (g_running) {
-		for (uint32_t i = 0; i < BUNDLE_SIZE; i++) {
-			read_cache_and_report(buf);
-			write_cache_and_report(buf);
-		}
+	// Per-thread rate, in read and write pairs per second.
+	double pairs_per_sec = (double)g_icfg.cache_thread_reads_and_writes_per_sec /
+			(double)(g_icfg.num_devices * g_icfg.cache_threads);
 
-		count += BUNDLE_SIZE;
+	pacer pc;
 
-		// TODO - someday (count * target_factor) may overflow a uint64_t.
-		uint64_t target_us = (count * target_factor) /
-				g_icfg.cache_thread_reads_and_writes_per_sec;
+	pacer_init(&pc, g_run_start_us * 1000, pairs_per_sec, ARRIVAL_UNIFORM);
 
-		int64_t sleep_us = (int64_t)(target_us - (get_us() - g_run_start_us));
+	while (g_running) {
+		uint64_t now_ns = pacer_wait(&pc);
 
-		if (sleep_us > 0) {
-			usleep((uint32_t)sleep_us);
+		for (uint32_t n = 0; n < MAX_PACED_BATCH && pacer_is_due(&pc, now_ns);
+				n++) {
+			uint64_t sched_ns = pacer_next(&pc);
+
+			read_cache_and_report(buf, sched_ns);
+			write_cache_and_report(buf, sched_ns);
 		}
-		else if (g_icfg.max_lag_usec != 0 &&
-				sleep_us < -(int64_t)g_icfg.max_lag_usec) {
+
+		if (g_icfg.max_lag_usec != 0 && pacer_lag_ns(&pc, get_ns()) >
+				(int64_t)g_icfg.max_lag_usec * 1000) {
 			printf("ERROR: cache thread device IO can't keep up\n");
 			printf("drive(s) can't keep up - test stopped\n");
 			g_running = false;
 		}
 	}
 
+	buf_pool_free(&pool);
+
 	return NULL;
 }
 
@@ -356,35 +547,42 @@ run_service(void* pv_unused)
 {
 	rand_seed_thread();
 
-	uint64_t count = 0;
 	uint64_t reads_per_sec =
 			g_icfg.service_thread_reads_per_sec / g_icfg.service_threads;
 
-	while (g_running) {
-		uint32_t random_dev_index = rand_32() % g_icfg.num_devices;
-		device* random_dev = &g_devices[random_dev_index];
+	buf_pool pool;
 
-		trans_req read_req = {
-				.dev = random_dev,
-				.offset = random_io_offset(random_dev)
-		};
+	if (! buf_pool_init(&pool, 1, IO_SIZE)) {
+		g_running = false;
+		return NULL;
+	}
 
-		uint8_t stack_buffer[IO_SIZE + 4096];
-		uint8_t* buf = align_4096(stack_buffer);
+	uint8_t* buf = buf_pool_get(&pool, 0);
 
-		read_and_report(&read_req, buf);
+	pacer pc;
 
-		count++;
+	pacer_init(&pc, g_run_start_us * 1000, (double)reads_per_sec,
+			g_icfg.arrival);
 
-		int64_t sleep_us = (int64_t)
-				(((count * 1000000) / reads_per_sec) -
-						(get_us() - g_run_start_us));
+	while (g_running) {
+		uint64_t now_ns = pacer_wait(&pc);
 
-		if (sleep_us > 0) {
-			usleep((uint32_t)sleep_us);
+		for (uint32_t n = 0; n < MAX_PACED_BATCH && pacer_is_due(&pc, now_ns);
+				n++) {
+			uint32_t random_dev_index = rand_32() % g_icfg.num_devices;
+			device* random_dev = &g_devices[random_dev_index];
+
+			trans_req read_req = {
+					.dev = random_dev,
+					.offset = random_read_offset(random_dev),
+					.sched_ns = pacer_next(&pc)
+			};
+
+			read_and_report(&read_req, buf);
 		}
-		else if (g_icfg.max_lag_usec != 0 &&
-				sleep_us < -(int64_t)g_icfg.max_lag_usec) {
+
+		if (g_icfg.max_lag_usec != 0 && pacer_lag_ns(&pc, get_ns()) >
+				(int64_t)g_icfg.max_lag_usec * 1000) {
 			printf("ERROR: read request generator can't keep up\n");
 			printf("ACT can't do requested load - test stopped\n");
 			printf("try configuring more 'service-threads'\n");
@@ -392,6 +590,135 @@ run_service(void* pv_unused)
 		}
 	}
 
+	buf_pool_free(&pool);
+
+	return NULL;
+}
+
+//------------------------------------------------
+// Cache simulation threads for asynchronous io
+// engines - alternate reads and writes, keeping
+// up to io-depth in flight.
+//
+static void*
+run_cache_simulation_async(void* pv_unused)
+{
+	rand_seed_thread();
+
+	async_thread at;
+
+	if (! async_thread_init(&at, g_icfg.io_depth)) {
+		g_running = false;
+		return NULL;
+	}
+
+	// Same per-thread rate as run_cache_simulation(), counting reads and
+	// writes separately.
+	double ops_per_sec = 2.0 *
+			(double)g_icfg.cache_thread_reads_and_writes_per_sec /
+			(double)(g_icfg.num_devices * g_icfg.cache_threads);
+
+	uint64_t count = 0;
+
+	run_async_paced(&at, ops_per_sec, prep_cache_op, (void*)&count,
+			"cache thread device IO");
+
+	async_thread_destroy(&at);
+
+	return NULL;
+}
+
+//------------------------------------------------
+// Service threads for asynchronous io engines -
+// generate device reads, keeping up to io-depth
+// in flight.
+//
+static void*
+run_service_async(void* pv_unused)
+{
+	rand_seed_thread();
+
+	async_thread at;
+
+	if (! async_thread_init(&at, g_icfg.io_depth)) {
+		g_running = false;
+		return NULL;
+	}
+
+	uint64_t reads_per_sec =
+			g_icfg.service_thread_reads_per_sec / g_icfg.service_threads;
+
+	run_async_paced(&at, (double)reads_per_sec, prep_service_op, NULL,
+			"read request generator");
+
+	async_thread_destroy(&at);
+
+	return NULL;
+}
+
+//------------------------------------------------
+// Closed-loop threads for the sync io engine -
+// closed-loop-queue-depth of these per device,
+// each doing one op after another, no pacing.
+//
+static void*
+run_closed_loop(void* pv_dev)
+{
+	rand_seed_thread();
+
+	buf_pool pool;
+
+	if (! buf_pool_init(&pool, 1, IO_SIZE)) {
+		g_running = false;
+		return NULL;
+	}
+
+	io_op op = { .buf = buf_pool_get(&pool, 0), .size = IO_SIZE };
+
+	while (g_running) {
+		prep_closed_loop_op(&op, pv_dev);
+		do_sync_op(&op);
+	}
+
+	buf_pool_free(&pool);
+
+	return NULL;
+}
+
+//------------------------------------------------
+// Closed-loop thread for asynchronous io engines -
+// one per device, keeping closed-loop-queue-depth
+// ops in flight, no pacing.
+//
+static void*
+run_closed_loop_async(void* pv_dev)
+{
+	rand_seed_thread();
+
+	async_thread at;
+
+	if (! async_thread_init(&at, g_icfg.closed_loop_qd)) {
+		g_running = false;
+		return NULL;
+	}
+
+	while (g_running) {
+		// Refill every completed slot. (Stop early if an op fails to submit,
+		// its slot will be retried after the next reap.)
+		while (at.n_free != 0 &&
+				submit_async_op(&at, prep_closed_loop_op, pv_dev, 0)) {
+			;
+		}
+
+		reap_and_report(&at, REAP_WAIT_US);
+	}
+
+	while (async_io_in_flight(at.aio) != 0) {
+		reap_and_report(&at, REAP_WAIT_US);
+	}
+
+	async_thread_destroy(&at);
+
 	return NULL;
 }
 
@@ -439,6 +766,8 @@ discover_device(device* dev)
 
 	dev->n_io_offsets = device_bytes / IO_SIZE;
 
+	offset_dist_init(&dev->read_dist, dev->n_io_offsets, &g_icfg.read_dist);
+
 	return true;
 }
 
@@ -487,6 +816,21 @@ fd_put(device* dev, int fd)
 	queue_push(dev->fd_q, (void*)&fd);
 }
 
+//------------------------------------------------
+// Most threads that may report ops, so histograms
+// can give each its own shard.
+//
+static uint32_t
+max_reporting_threads()
+{
+	if (g_icfg.closed_loop_qd != 0) {
+		return g_icfg.num_devices * (g_icfg.io_engine != IO_ENGINE_SYNC ?
+				1 : g_icfg.closed_loop_qd);
+	}
+
+	return g_icfg.cache_threads + g_icfg.service_threads;
+}
+
 //------------------------------------------------
 // Do one transaction read operation and report.
 //
@@ -497,10 +841,8 @@ read_and_report(trans_req* read_req, uint8_t* buf)
 	uint64_t stop_time = read_from_device(read_req->dev, read_req->offset, buf);
 
 	if (stop_time != -1) {
-		histogram_insert_data_point(g_read_hist,
-				safe_delta_ns(start_time, stop_time));
-		histogram_insert_data_point(read_req->dev->read_hist,
-				safe_delta_ns(start_time, stop_time));
+		report_op(OP_READ, read_req->dev, read_req->sched_ns, start_time,
+				stop_time);
 	}
 }
 
@@ -508,20 +850,17 @@ read_and_report(trans_req* read_req, uint8_t* buf)
 // Do one cache thread read operation and report.
 //
 static void
-read_cache_and_report(uint8_t* buf)
+read_cache_and_report(uint8_t* buf, uint64_t sched_ns)
 {
 	uint32_t random_device_index = rand_32() % g_icfg.num_devices;
 	device* p_device = &g_devices[random_device_index];
-	uint64_t offset = random_io_offset(p_device);
+	uint64_t offset = random_read_offset(p_device);
 
 	uint64_t start_time = get_ns();
 	uint64_t stop_time = read_from_device(p_device, offset, buf);
 
 	if (stop_time != -1) {
-		histogram_insert_data_point(g_read_hist,
-				safe_delta_ns(start_time, stop_time));
-		histogram_insert_data_point(p_device->read_hist,
-				safe_delta_ns(start_time, stop_time));
+		report_op(OP_READ, p_device, sched_ns, start_time, stop_time);
 	}
 }
 
@@ -551,11 +890,56 @@ read_from_device(device* dev, uint64_t offset, uint8_t* buf)
 	return stop_ns;
 }
 
+//------------------------------------------------
+// Insert a completed op's latency in the relevant
+// histograms, and in closed-loop mode, count it.
+// If co-histograms, also insert latency measured
+// from when the op was scheduled to start. (Ops
+// started early use their actual start instead.)
+//
+static void
+report_op(op_type type, device* dev, uint64_t sched_ns, uint64_t start_ns,
+		uint64_t stop_ns)
+{
+	uint64_t delta_ns = safe_delta_ns(start_ns, stop_ns);
+
+	switch (type) {
+	case OP_READ:
+		histogram_insert_data_point(g_read_hist, delta_ns);
+		histogram_insert_data_point(dev->read_hist, delta_ns);
+		break;
+	case OP_WRITE:
+		histogram_insert_data_point(g_write_hist, delta_ns);
+		histogram_insert_data_point(dev->write_hist, delta_ns);
+		break;
+	}
+
+	if (g_icfg.closed_loop_qd != 0) {
+		__atomic_fetch_add(&dev->n_ops, 1, __ATOMIC_RELAXED);
+	}
+
+	if (! g_icfg.co_histograms) {
+		return;
+	}
+
+	uint64_t co_delta_ns =
+			safe_delta_ns(sched_ns < start_ns ? sched_ns : start_ns, stop_ns);
+
+	switch (type) {
+	case OP_READ:
+		histogram_insert_data_point(g_co_read_hist, co_delta_ns);
+		break;
+	case OP_WRITE:
+		histogram_insert_data_point(g_co_write_hist, co_delta_ns);
+		break;
+	}
+}
+
 //------------------------------------------------
 // Do one cache thread write operation and report.
 //
 static void
-write_cache_and_report(uint8_t* buf)
+write_cache_and_report(uint8_t* buf, uint64_t sched_ns)
 {
 	// Salt the buffer each time.
 	rand_fill(buf, IO_SIZE, 100);
@@ -568,10 +952,7 @@ write_cache_and_report(uint8_t* buf)
 	uint64_t stop_time = write_to_device(p_device, offset, buf);
 
 	if (stop_time != -1) {
-		histogram_insert_data_point(g_write_hist,
-				safe_delta_ns(start_time, stop_time));
-		histogram_insert_data_point(p_device->write_hist,
-				safe_delta_ns(start_time, stop_time));
+		report_op(OP_WRITE, p_device, sched_ns, start_time, stop_time);
 	}
 }
 
@@ -600,3 +981,334 @@ write_to_device(device* dev, uint64_t offset, const uint8_t* buf)
 
 	return stop_ns;
 }
+
+
+//==========================================================
+// Local helpers - asynchronous io engines.
+//
+
+//------------------------------------------------
+// Set up a thread's io context, and 'depth' ops
+// with pooled aligned buffers.
+//
+static bool
+async_thread_init(async_thread* at, uint32_t depth)
+{
+	at->depth = depth;
+	at->pool.mem = NULL;
+
+	if ((at->aio = async_io_create(g_icfg.io_engine, depth)) == NULL) {
+		return false;
+	}
+
+	at->ops = calloc(depth, sizeof(io_op));
+	at->free_ops = malloc(depth * sizeof(io_op*));
+
+	if (at->ops == NULL || at->free_ops == NULL) {
+		printf("ERROR: async thread ops (malloc)\n");
+		async_thread_destroy(at);
+		return false;
+	}
+
+	if (! buf_pool_init(&at->pool, depth, IO_SIZE)) {
+		async_thread_destroy(at);
+		return false;
+	}
+
+	at->n_free = 0;
+
+	for (uint32_t i = 0; i < depth; i++) {
+		io_op* op = &at->ops[i];
+
+		op->buf = buf_pool_get(&at->pool, i);
+
+		op->size = IO_SIZE;
+		at->free_ops[at->n_free++] = op;
+	}
+
+	return true;
+}
+
+//------------------------------------------------
+// Tear down a thread's io context and ops. All
+// ops must have been reaped.
+//
+static void
+async_thread_destroy(async_thread* at)
+{
+	buf_pool_free(&at->pool);
+	free(at->ops);
+	free(at->free_ops);
+	async_io_destroy(at->aio);
+}
+
+static void
+prep_cache_op(io_op* op, void* pv_count)
+{
+	uint64_t* p_count = (uint64_t*)pv_count;
+	uint32_t random_device_index = rand_32() % g_icfg.num_devices;
+	device* p_device = &g_devices[random_device_index];
+
+	if (((*p_count)++ & 1) == 0) {
+		prep_read(op, p_device);
+	}
+	else {
+		prep_write(op, p_device);
+	}
+}
+
+static void
+prep_read(io_op* op, device* dev)
+{
+	op->udata = (void*)dev;
+	op->tag = OP_READ;
+	op->is_write = false;
+	op->offset = random_read_offset(dev);
+}
+
+static void
+prep_service_op(io_op* op, void* pv_unused)
+{
+	uint32_t random_dev_index = rand_32() % g_icfg.num_devices;
+	device* random_dev = &g_devices[random_dev_index];
+
+	prep_read(op, random_dev);
+}
+
+static void
+prep_write(io_op* op, device* dev)
+{
+	op->udata = (void*)dev;
+	op->tag = OP_WRITE;
+	op->is_write = true;
+	op->offset = random_io_offset(dev);
+
+	// Salt the buffer each time.
+	rand_fill(op->buf, IO_SIZE, 100);
+}
+
+//------------------------------------------------
+// Collect completed ops, waiting up to timeout_us
+// for at least one, report them, and recycle them.
+//
+static void
+reap_and_report(async_thread* at, uint64_t timeout_us)
+{
+	io_op* done[at->depth];
+	uint32_t n_done = async_io_reap(at->aio, done, at->depth, timeout_us);
+	uint64_t stop_ns = get_ns();
+
+	for (uint32_t i = 0; i < n_done; i++) {
+		report_async_op(done[i], stop_ns);
+		at->free_ops[at->n_free++] = done[i];
+	}
+}
+
+//------------------------------------------------
+// Report one completed op - latency is measured
+// from submission to completion.
+//
+static void
+report_async_op(io_op* op, uint64_t stop_ns)
+{
+	device* dev = (device*)op->udata;
+
+	if (op->res != (int32_t)op->size) {
+		close(op->fd);
+
+		if (op->res < 0) {
+			printf("ERROR: %s %s: %d '%s'\n",
+					op->is_write ? "writing" : "reading", dev->name, -op->res,
+					act_strerror(-op->res));
+		}
+		else {
+			printf("ERROR: %s %s: %d of %u bytes\n",
+					op->is_write ? "writing" : "reading", dev->name, op->res,
+					op->size);
+		}
+
+		return;
+	}
+
+	fd_put(dev, op->fd);
+
+	report_op((op_type)op->tag, dev, op->sched_ns, op->start_ns, stop_ns);
+}
+
+//------------------------------------------------
+// Issue ops at a constant rate, keeping up to
+// io-depth in flight, and waiting for completions
+// in between. Drains all ops in flight on exit.
+//
+static void
+run_async_paced(async_thread* at, double ops_per_sec, prep_fn prep,
+		void* udata, const char* what)
+{
+	pacer pc;
+
+	// Only client requests follow arrival-distribution.
+	pacer_init(&pc, g_run_start_us * 1000, ops_per_sec,
+			prep == prep_service_op ? g_icfg.arrival : ARRIVAL_UNIFORM);
+
+	while (g_running) {
+		uint64_t now_ns = get_ns();
+
+		bool submit_failed = false;
+
+		while (at->n_free != 0 && pacer_is_due(&pc, now_ns)) {
+			if (! submit_async_op(at, prep, udata, pacer_next(&pc))) {
+				submit_failed = true;
+				break;
+			}
+		}
+
+		// A failed submit is a hard error - the op would be silently lost.
+		if (submit_failed) {
+			printf("ERROR: %s can't submit - test stopped\n", what);
+			g_running = false;
+			break;
+		}
+
+		int64_t lag_ns = pacer_lag_ns(&pc, now_ns);
+
+		if (g_icfg.max_lag_usec != 0 &&
+				lag_ns > (int64_t)g_icfg.max_lag_usec * 1000) {
+			printf("ERROR: %s can't keep up\n", what);
+
+			if (prep == prep_service_op) {
+				printf("ACT can't do requested load - test stopped\n");
+				printf("try configuring more 'service-threads' or 'io-depth'\n");
+			}
+			else {
+				printf("drive(s) can't keep up - test stopped\n");
+			}
+
+			g_running = false;
+			break;
+		}
+
+		// Wait for completions, or until the next op is due.
+		reap_and_report(at, lag_ns < 0 ?
+				(uint64_t)(-lag_ns + 999) / 1000 : REAP_WAIT_US);
+	}
+
+	while (async_io_in_flight(at->aio) != 0) {
+		reap_and_report(at, REAP_WAIT_US);
+	}
+}
+
+//------------------------------------------------
+// Prepare and submit one op. If it can't be
+// submitted, it goes straight back on the free
+// list.
+//
+static bool
+submit_async_op(async_thread* at, prep_fn prep, void* udata,
+		uint64_t sched_ns)
+{
+	io_op* op = at->free_ops[--at->n_free];
+
+	prep(op, udata);
+	op->sched_ns = sched_ns;
+
+	device* dev = (device*)op->udata;
+
+	if ((op->fd = fd_get(dev)) == -1) {
+		at->free_ops[at->n_free++] = op;
+		return false;
+	}
+
+	if (! async_io_submit(at->aio, op)) {
+		fd_put(dev, op->fd);
+		at->free_ops[at->n_free++] = op;
+		return false;
+	}
+
+	return true;
+}
+
+
+//==========================================================
+// Local helpers - closed-loop mode.
+//
+
+//------------------------------------------------
+// Do one op synchronously and report.
+//
+static void
+do_sync_op(io_op* op)
+{
+	device* dev = (device*)op->udata;
+	uint64_t start_ns = get_ns();
+	uint64_t stop_ns = op->is_write ?
+			write_to_device(dev, op->offset, op->buf) :
+			read_from_device(dev, op->offset, op->buf);
+
+	if (stop_ns != -1) {
+		report_op((op_type)op->tag, dev, start_ns, start_ns, stop_ns);
+	}
+}
+
+//------------------------------------------------
+// Pick the next op on a device, in proportion to
+// the configured load's op mix.
+//
+static void
+prep_closed_loop_op(io_op* op, void* pv_dev)
+{
+	device* dev = (device*)pv_dev;
+
+	if (g_closed_loop_read_split > rand_64() % SPLIT_RESOLUTION) {
+		prep_read(op, dev);
+	}
+	else {
+		prep_write(op, dev);
+	}
+}
+
+//------------------------------------------------
+// Print achieved throughput since last report,
+// overall and per device.
+//
+static void
+report_throughput(uint64_t interval_us)
+{
+	double interval_sec = (double)interval_us / 1000000;
+	double mbytes_per_op = (double)IO_SIZE / (1024 * 1024);
+	uint64_t n_ops[g_icfg.num_devices];
+	uint64_t total_ops = 0;
+
+	for (uint32_t d = 0; d < g_icfg.num_devices; d++) {
+		n_ops[d] = __atomic_exchange_n(&g_devices[d].n_ops, 0,
+				__ATOMIC_RELAXED);
+		total_ops += n_ops[d];
+	}
+
+	printf("throughput: %.1lf iops, %.2lf MB/s\n",
+			(double)total_ops / interval_sec,
+			(double)total_ops * mbytes_per_op / interval_sec);
+
+	for (uint32_t d = 0; d < g_icfg.num_devices; d++) {
+		printf("%s-throughput: %.1lf iops, %.2lf MB/s\n", g_devices[d].name,
+				(double)n_ops[d] / interval_sec,
+				(double)n_ops[d] * mbytes_per_op / interval_sec);
+	}
+}
+
+//------------------------------------------------
+// Derive closed-loop op mix from configured load.
+// Service threads only read, cache threads read
+// and write equally. The rates only serve as
+// relative weights here.
+//
+static void
+set_closed_loop_split()
+{
+	double reads_per_sec = (double)g_icfg.service_thread_reads_per_sec +
+			(double)g_icfg.cache_thread_reads_and_writes_per_sec;
+	double writes_per_sec =
+			(double)g_icfg.cache_thread_reads_and_writes_per_sec;
+
+	g_closed_loop_read_split = (uint64_t)(SPLIT_RESOLUTION * reads_per_sec /
+			(reads_per_sec + writes_per_sec));
+}
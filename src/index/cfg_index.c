@@ -37,7 +37,8 @@
 #include <string.h>
 
 #include "common/cfg.h"
-#include "common/hardware.h"
+#include "common/hdr_histogram.h"
+#include "common/random.h"
 #include "common/trace.h"
 
 
@@ -52,12 +53,33 @@ static const char TAG_CACHE_THREADS[]           = "cache-threads";
 static const char TAG_TEST_DURATION_SEC[]       = "test-duration-sec";
 static const char TAG_REPORT_INTERVAL_SEC[]     = "report-interval-sec";
 static const char TAG_MICROSECOND_HISTOGRAMS[]  = "microsecond-histograms";
+static const char TAG_NANOSECOND_HISTOGRAMS[]   = "nanosecond-histograms";
 static const char TAG_READ_REQS_PER_SEC[]       = "read-reqs-per-sec";
 static const char TAG_WRITE_REQS_PER_SEC[]      = "write-reqs-per-sec";
 static const char TAG_REPLICATION_FACTOR[]      = "replication-factor";
 static const char TAG_DEFRAG_LWM_PCT[]          = "defrag-lwm-pct";
 static const char TAG_DISABLE_ODSYNC[]          = "disable-odsync";
 static const char TAG_MAX_LAG_SEC[]             = "max-lag-sec";
+static const char TAG_IO_ENGINE[]               = "io-engine";
+static const char TAG_IO_DEPTH[]                = "io-depth";
+static const char TAG_CLOSED_LOOP_QUEUE_DEPTH[] = "closed-loop-queue-depth";
+static const char TAG_CO_HISTOGRAMS[]           = "co-histograms";
+static const char TAG_HDR_SIGNIFICANT_DIGITS[]  = "hdr-significant-digits";
+static const char TAG_ARRIVAL_DISTRIBUTION[]    = "arrival-distribution";
+static const char TAG_READ_DISTRIBUTION[]       = "read-distribution";
+static const char TAG_READ_ZIPF_THETA[]         = "read-zipf-theta";
+static const char TAG_READ_HOT_OPS_PCT[]        = "read-hot-ops-pct";
+static const char TAG_READ_HOT_SPACE_PCT[]      = "read-hot-space-pct";
+static const char TAG_READ_EXP_MEAN_PCT[]       = "read-exp-mean-pct";
+static const char TAG_SERVICE_CPUS[]            = "service-cpus";
+static const char TAG_CACHE_CPUS[]              = "cache-cpus";
+static const char TAG_CLOSED_LOOP_CPUS[]        = "closed-loop-cpus";
+static const char TAG_REPORTER_CPUS[]           = "reporter-cpus";
+static const char TAG_SCHED_FIFO_PRIORITY[]     = "sched-fifo-priority";
+static const char TAG_INTERVAL_LOG_FILE[]       = "interval-log-file";
+static const char TAG_INTERVAL_LOG_FORMAT[]     = "interval-log-format";
+
+#define MAX_IO_DEPTH 4096
 
 
 //==========================================================
@@ -79,7 +101,17 @@ index_cfg g_icfg = {
 		.report_interval_us = 1000000,
 		.replication_factor = 1,
 		.defrag_lwm_pct = 50,
-		.max_lag_usec = 1000000 * 10
+		.max_lag_usec = 1000000 * 10,
+		.io_engine = IO_ENGINE_SYNC,
+		.arrival = ARRIVAL_UNIFORM,
+		.read_dist = {
+				.type = OFFSET_DIST_UNIFORM,
+				.zipf_theta = 0.99,
+				.hot_ops_pct = 90,
+				.hot_space_pct = 10,
+				.exp_mean_pct = 10
+		},
+		.io_depth = 32
 };
 
 
@@ -140,6 +172,9 @@ index_configure(int argc, char* argv[])
 		else if (strcmp(tag, TAG_MICROSECOND_HISTOGRAMS) == 0) {
 			g_icfg.us_histograms = parse_yes_no();
 		}
+		else if (strcmp(tag, TAG_NANOSECOND_HISTOGRAMS) == 0) {
+			g_icfg.ns_histograms = parse_yes_no();
+		}
 		else if (strcmp(tag, TAG_READ_REQS_PER_SEC) == 0) {
 			g_icfg.read_reqs_per_sec = parse_uint32();
 		}
@@ -158,6 +193,64 @@ index_configure(int argc, char* argv[])
 		else if (strcmp(tag, TAG_MAX_LAG_SEC) == 0) {
 			g_icfg.max_lag_usec = (uint64_t)parse_uint32() * 1000000;
 		}
+		else if (strcmp(tag, TAG_IO_ENGINE) == 0) {
+			g_icfg.io_engine = parse_io_engine();
+		}
+		else if (strcmp(tag, TAG_IO_DEPTH) == 0) {
+			g_icfg.io_depth = parse_uint32();
+		}
+		else if (strcmp(tag, TAG_CLOSED_LOOP_QUEUE_DEPTH) == 0) {
+			g_icfg.closed_loop_qd = parse_uint32();
+		}
+		else if (strcmp(tag, TAG_CO_HISTOGRAMS) == 0) {
+			g_icfg.co_histograms = parse_yes_no();
+		}
+		else if (strcmp(tag, TAG_HDR_SIGNIFICANT_DIGITS) == 0) {
+			g_icfg.hdr_significant_digits = parse_uint32();
+		}
+		else if (strcmp(tag, TAG_ARRIVAL_DISTRIBUTION) == 0) {
+			g_icfg.arrival = parse_arrival_dist();
+		}
+		else if (strcmp(tag, TAG_READ_DISTRIBUTION) == 0) {
+			g_icfg.read_dist.type = parse_offset_dist_type();
+		}
+		else if (strcmp(tag, TAG_READ_ZIPF_THETA) == 0) {
+			g_icfg.read_dist.zipf_theta = parse_double();
+		}
+		else if (strcmp(tag, TAG_READ_HOT_OPS_PCT) == 0) {
+			g_icfg.read_dist.hot_ops_pct = parse_uint32();
+		}
+		else if (strcmp(tag, TAG_READ_HOT_SPACE_PCT) == 0) {
+			g_icfg.read_dist.hot_space_pct = parse_uint32();
+		}
+		else if (strcmp(tag, TAG_READ_EXP_MEAN_PCT) == 0) {
+			g_icfg.read_dist.exp_mean_pct = parse_double();
+		}
+		else if (strcmp(tag, TAG_SERVICE_CPUS) == 0) {
+			parse_thread_cpus(&g_icfg.service_cpus);
+		}
+		else if (strcmp(tag, TAG_CACHE_CPUS) == 0) {
+			parse_thread_cpus(&g_icfg.cache_cpus);
+		}
+		else if (strcmp(tag, TAG_CLOSED_LOOP_CPUS) == 0) {
+			parse_thread_cpus(&g_icfg.closed_loop_cpus);
+		}
+		else if (strcmp(tag, TAG_REPORTER_CPUS) == 0) {
+			parse_thread_cpus(&g_icfg.reporter_cpus);
+		}
+		else if (strcmp(tag, TAG_SCHED_FIFO_PRIORITY) == 0) {
+			g_icfg.sched_fifo_priority = parse_uint32();
+		}
+		else if (strcmp(tag, TAG_INTERVAL_LOG_FILE) == 0) {
+			if (! parse_file_name(g_icfg.interval_log_file,
+					sizeof(g_icfg.interval_log_file))) {
+				configuration_error(tag);
+				return false;
+			}
+		}
+		else if (strcmp(tag, TAG_INTERVAL_LOG_FORMAT) == 0) {
+			g_icfg.interval_log_format = parse_interval_log_format();
+		}
 		else {
 			printf("ERROR: ignoring unknown config item '%s'\n", tag);
 			return false;
@@ -188,8 +281,17 @@ check_configuration()
 		return false;
 	}
 
+	if (! check_thread_cpus(&g_icfg.service_cpus, TAG_SERVICE_CPUS) ||
+			! check_thread_cpus(&g_icfg.cache_cpus, TAG_CACHE_CPUS) ||
+			! check_thread_cpus(&g_icfg.closed_loop_cpus,
+					TAG_CLOSED_LOOP_CPUS) ||
+			! check_thread_cpus(&g_icfg.reporter_cpus, TAG_REPORTER_CPUS)) {
+		return false;
+	}
+
 	if (g_icfg.service_threads == 0 &&
-			(g_icfg.service_threads = 5 * num_cpus()) == 0) {
+			(g_icfg.service_threads =
+					default_service_threads(&g_icfg.service_cpus)) == 0) {
 		configuration_error(TAG_SERVICE_THREADS);
 		return false;
 	}
@@ -209,6 +311,13 @@ check_configuration()
 		return false;
 	}
 
+	// Even in closed-loop mode, where they're only relative weights.
+	if (g_icfg.read_reqs_per_sec + g_icfg.write_reqs_per_sec == 0) {
+		printf("ERROR: %s and %s can't both be zero\n", TAG_READ_REQS_PER_SEC,
+				TAG_WRITE_REQS_PER_SEC);
+		return false;
+	}
+
 	if (g_icfg.replication_factor == 0) {
 		configuration_error(TAG_REPLICATION_FACTOR);
 		return false;
@@ -219,18 +328,86 @@ check_configuration()
 		return false;
 	}
 
+	if (g_icfg.us_histograms && g_icfg.ns_histograms) {
+		configuration_error(TAG_NANOSECOND_HISTOGRAMS);
+		return false;
+	}
+
+	if (g_icfg.io_engine == IO_ENGINE_INVALID) {
+		configuration_error(TAG_IO_ENGINE);
+		return false;
+	}
+
+	if (g_icfg.io_depth == 0 || g_icfg.io_depth > MAX_IO_DEPTH) {
+		configuration_error(TAG_IO_DEPTH);
+		return false;
+	}
+
+	if (g_icfg.closed_loop_qd > MAX_IO_DEPTH) {
+		configuration_error(TAG_CLOSED_LOOP_QUEUE_DEPTH);
+		return false;
+	}
+
+	// Closed-loop mode has no schedule to measure from.
+	if (g_icfg.co_histograms && g_icfg.closed_loop_qd != 0) {
+		configuration_error(TAG_CO_HISTOGRAMS);
+		return false;
+	}
+
+	if (g_icfg.hdr_significant_digits > MAX_HDR_SIGNIFICANT_DIGITS) {
+		configuration_error(TAG_HDR_SIGNIFICANT_DIGITS);
+		return false;
+	}
+
+	if (g_icfg.arrival == ARRIVAL_INVALID) {
+		configuration_error(TAG_ARRIVAL_DISTRIBUTION);
+		return false;
+	}
+
+	if (g_icfg.read_dist.type == OFFSET_DIST_INVALID) {
+		configuration_error(TAG_READ_DISTRIBUTION);
+		return false;
+	}
+
+	// Written so NAN fails.
+	if (! (g_icfg.read_dist.zipf_theta > 0 && g_icfg.read_dist.zipf_theta < 1)) {
+		configuration_error(TAG_READ_ZIPF_THETA);
+		return false;
+	}
+
+	if (g_icfg.read_dist.hot_ops_pct > 100) {
+		configuration_error(TAG_READ_HOT_OPS_PCT);
+		return false;
+	}
+
+	if (g_icfg.read_dist.hot_space_pct == 0 ||
+			g_icfg.read_dist.hot_space_pct > 100) {
+		configuration_error(TAG_READ_HOT_SPACE_PCT);
+		return false;
+	}
+
+	if (! (g_icfg.read_dist.exp_mean_pct > 0 &&
+			g_icfg.read_dist.exp_mean_pct <= 100)) {
+		configuration_error(TAG_READ_EXP_MEAN_PCT);
+		return false;
+	}
+
+	if (g_icfg.sched_fifo_priority > MAX_FIFO_PRIORITY) {
+		configuration_error(TAG_SCHED_FIFO_PRIORITY);
+		return false;
+	}
+
+	if (g_icfg.interval_log_format == INTERVAL_LOG_INVALID) {
+		configuration_error(TAG_INTERVAL_LOG_FORMAT);
+		return false;
+	}
+
 	return true;
 }
 
 static bool
 derive_configuration()
 {
-	if (g_icfg.read_reqs_per_sec + g_icfg.write_reqs_per_sec == 0) {
-		printf("ERROR: %s and %s can't both be zero\n", TAG_READ_REQS_PER_SEC,
-				TAG_WRITE_REQS_PER_SEC);
-		return false;
-	}
-
 	// 'replication-factor' > 1 causes replica writes.
 	uint32_t effective_write_reqs_per_sec =
 			g_icfg.replication_factor * g_icfg.write_reqs_per_sec;
@@ -261,6 +438,10 @@ derive_configuration()
 			effective_write_reqs_per_sec *
 			cache_thread_reads_and_writes_per_write;
 
+	// Only threads that keep a schedule get real-time priority.
+	g_icfg.service_cpus.fifo_priority = g_icfg.sched_fifo_priority;
+	g_icfg.cache_cpus.fifo_priority = g_icfg.sched_fifo_priority;
+
 	return true;
 }
 
@@ -292,6 +473,8 @@ echo_configuration()
 			g_icfg.report_interval_us / 1000000);
 	printf("%s: %s\n", TAG_MICROSECOND_HISTOGRAMS,
 			g_icfg.us_histograms ? "yes" : "no");
+	printf("%s: %s\n", TAG_NANOSECOND_HISTOGRAMS,
+			g_icfg.ns_histograms ? "yes" : "no");
 	printf("%s: %" PRIu32 "\n", TAG_READ_REQS_PER_SEC,
 			g_icfg.read_reqs_per_sec);
 	printf("%s: %" PRIu32 "\n", TAG_WRITE_REQS_PER_SEC,
@@ -304,6 +487,46 @@ echo_configuration()
 			g_icfg.disable_odsync ? "yes" : "no");
 	printf("%s: %" PRIu64 "\n", TAG_MAX_LAG_SEC,
 			g_icfg.max_lag_usec / 1000000);
+	printf("%s: %s\n", TAG_IO_ENGINE,
+			io_engine_name(g_icfg.io_engine));
+	printf("%s: %" PRIu32 "\n", TAG_IO_DEPTH,
+			g_icfg.io_depth);
+	printf("%s: %" PRIu32 "\n", TAG_CLOSED_LOOP_QUEUE_DEPTH,
+			g_icfg.closed_loop_qd);
+	printf("%s: %s\n", TAG_CO_HISTOGRAMS,
+			g_icfg.co_histograms ? "yes" : "no");
+	printf("%s: %" PRIu32 "\n", TAG_HDR_SIGNIFICANT_DIGITS,
+			g_icfg.hdr_significant_digits);
+	printf("%s: %s\n", TAG_ARRIVAL_DISTRIBUTION,
+			arrival_dist_name(g_icfg.arrival));
+	printf("%s: %s\n", TAG_READ_DISTRIBUTION,
+			offset_dist_type_name(g_icfg.read_dist.type));
+	printf("%s: %.3lf\n", TAG_READ_ZIPF_THETA,
+			g_icfg.read_dist.zipf_theta);
+	printf("%s: %" PRIu32 "\n", TAG_READ_HOT_OPS_PCT,
+			g_icfg.read_dist.hot_ops_pct);
+	printf("%s: %" PRIu32 "\n", TAG_READ_HOT_SPACE_PCT,
+			g_icfg.read_dist.hot_space_pct);
+	printf("%s: %.3lf\n", TAG_READ_EXP_MEAN_PCT,
+			g_icfg.read_dist.exp_mean_pct);
+
+	char buf[1000];
+
+	printf("%s: %s\n", TAG_SERVICE_CPUS,
+			thread_cpus_string(&g_icfg.service_cpus, buf, sizeof(buf)));
+	printf("%s: %s\n", TAG_CACHE_CPUS,
+			thread_cpus_string(&g_icfg.cache_cpus, buf, sizeof(buf)));
+	printf("%s: %s\n", TAG_CLOSED_LOOP_CPUS,
+			thread_cpus_string(&g_icfg.closed_loop_cpus, buf, sizeof(buf)));
+	printf("%s: %s\n", TAG_REPORTER_CPUS,
+			thread_cpus_string(&g_icfg.reporter_cpus, buf, sizeof(buf)));
+	printf("%s: %" PRIu32 "\n", TAG_SCHED_FIFO_PRIORITY,
+			g_icfg.sched_fifo_priority);
+	printf("%s: %s\n", TAG_INTERVAL_LOG_FILE,
+			g_icfg.interval_log_file[0] == '\0' ?
+					"none" : g_icfg.interval_log_file);
+	printf("%s: %s\n", TAG_INTERVAL_LOG_FORMAT,
+			interval_log_format_name(g_icfg.interval_log_format));
 
 	printf("\nDERIVED CONFIGURATION\n");
 
@@ -311,6 +534,7 @@ echo_configuration()
 			g_icfg.service_thread_reads_per_sec);
 	printf("cache-thread-reads-and-writes-per-sec: %" PRIu64 "\n",
 			g_icfg.cache_thread_reads_and_writes_per_sec);
+	printf("random-fill: %s\n", rand_fill_name());
 
 	printf("\n");
 }
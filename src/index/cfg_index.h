@@ -31,7 +31,12 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "common/async_io.h"
 #include "common/cfg.h"
+#include "common/interval_log.h"
+#include "common/offset_dist.h"
+#include "common/pacer.h"
+#include "common/thread_cfg.h"
 
 
 //==========================================================
@@ -49,12 +54,27 @@ typedef struct index_cfg_s {
 	uint64_t run_us;                // converted from literal units in seconds
 	uint64_t report_interval_us;    // converted from literal units in seconds
 	bool us_histograms;
+	bool ns_histograms;
 	uint32_t read_reqs_per_sec;
 	uint32_t write_reqs_per_sec;
 	uint32_t replication_factor;
 	uint32_t defrag_lwm_pct;
 	bool disable_odsync;
 	uint64_t max_lag_usec;          // converted from literal units in seconds
+	io_engine io_engine;
+	uint32_t io_depth;
+	uint32_t closed_loop_qd;        // 0 means open loop (normal rate-driven)
+	bool co_histograms;
+	uint32_t hdr_significant_digits; // 0 means no log-linear histograms
+	arrival_dist arrival;
+	offset_dist_cfg read_dist;      // where reads land
+	thread_cfg service_cpus;
+	thread_cfg cache_cpus;
+	thread_cfg closed_loop_cpus;
+	thread_cfg reporter_cpus;       // main thread, after startup
+	uint32_t sched_fifo_priority;   // 0 means normal scheduling
+	char interval_log_file[MAX_FILE_NAME_SIZE]; // empty means no log
+	interval_log_format interval_log_format;
 
 	// Derived from literal configuration:
 	uint64_t service_thread_reads_per_sec;
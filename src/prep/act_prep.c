@@ -146,9 +146,8 @@ main(int argc, char* argv[])
 	//------------------------
 	// Begin salting.
 
-	printf("salting device %s\n", g_device_name);
-
-	rand_seed();
+	printf("salting device %s (%s random fill)\n", g_device_name,
+			rand_seed());
 
 	pthread_t salt_threads[NUM_SALT_THREADS];
 
@@ -36,6 +36,7 @@
 #include <fcntl.h>
 #include <inttypes.h>
 #include <pthread.h>
+#include <sched.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -47,27 +48,49 @@
 #include <sys/stat.h>
 #include <sys/ioctl.h>
 
+#include "common/async_io.h"
+#include "common/buf_pool.h"
 #include "common/cfg.h"
 #include "common/clock.h"
 #include "common/hardware.h"
 #include "common/histogram.h"
+#include "common/interval_log.h"
 #include "common/io.h"
+#include "common/offset_dist.h"
+#include "common/pacer.h"
+#include "common/payload.h"
 #include "common/queue.h"
 #include "common/random.h"
+#include "common/thread_cfg.h"
 #include "common/trace.h"
 #include "common/version.h"
 
 #include "cfg_storage.h"
+#include "wblocks.h"
 
 
 //==========================================================
 // Typedefs & constants.
 //
 
+typedef struct svc_group_s svc_group;
+
 typedef struct device_s {
 	const char* name;
+	int32_t numa_node;      // -1 if not placed
+	cpu_set_t numa_cpus;    // if placed - threads for this device run here
+	svc_group* svc_group;   // service threads that start on this device's node
+	cpu_set_t* queue_cpus;  // if hw-queue-placement - usable CPUs per queue
+	uint32_t n_queue_cpus;  // hardware queues with usable CPUs
+	uint32_t n_hw_queues;   // if hw-queue-stats
+	uint16_t* cpu_hw_queue; // if hw-queue-stats - queue each CPU submits to
+	uint64_t* n_hw_queue_submits; // if hw-queue-stats
 	uint64_t n_large_blocks;
+	wblocks wblocks;        // if log-structured writes
+	uint32_t* cache_seqs;   // if post-write cache - block's latest write_seq
+	uint32_t write_seq;     // large-block writes so far, wrapping
 	uint64_t n_read_offsets;
+	offset_dist read_dist;
 	uint64_t n_write_offsets;
 	uint32_t min_op_bytes;
 	uint32_t min_commit_bytes;
@@ -79,18 +102,67 @@ typedef struct device_s {
 	pthread_t large_block_read_thread;
 	pthread_t large_block_write_thread;
 	pthread_t tomb_raider_thread;
+	pthread_t* closed_loop_threads;
 	histogram* read_hist;
 	histogram* write_hist;
 	char read_hist_tag[MAX_DEVICE_NAME_SIZE + 1 + 5];
 	char write_hist_tag[MAX_DEVICE_NAME_SIZE + 1 + 6];
+	uint64_t n_ops;      // counted in closed-loop mode only
+	uint64_t n_bytes;    // counted in closed-loop mode only
+	uint64_t n_full_flushes;    // counted if flush-max-ms only
+	uint64_t n_partial_flushes; // counted if flush-max-ms only
+	uint64_t n_partial_bytes;   // counted if flush-max-ms only
+	uint64_t n_cache_hits;      // counted if post-write cache only
+	uint64_t n_cache_misses;    // counted if post-write cache only
 } device;
 
+// Devices service threads pick from - all of them, or with numa-placement,
+// those on one NUMA node.
+struct svc_group_s {
+	int32_t numa_node;      // -1 if not placed
+	const cpu_set_t* cpus;  // NULL if not placed
+	uint32_t n_devices;
+	device* devices[MAX_NUM_STORAGE_DEVICES];
+	uint64_t read_split;    // of SPLIT_RESOLUTION
+	uint32_t n_threads;
+	double thread_reqs_per_sec;
+};
+
 typedef struct trans_req_s {
 	device* dev;
 	uint64_t offset;
 	uint32_t size;
+	uint64_t sched_ns;
 } trans_req;
 
+typedef enum {
+	OP_READ,
+	OP_WRITE,
+	OP_LARGE_BLOCK_READ,
+	OP_LARGE_BLOCK_WRITE
+} op_type;
+
+// Per-thread state when using an asynchronous io engine.
+typedef struct async_thread_s {
+	async_io* aio;
+	uint32_t depth;
+	io_op* ops;
+	io_op** free_ops;
+	uint32_t n_free;
+	buf_pool pool;      // one buffer per op
+} async_thread;
+
+// Fills in an io_op's device, type, offset, size and write data.
+typedef void (*prep_fn)(io_op* op, void* udata);
+
+#define REAP_WAIT_US 1000
+
+// How long a stateful defrag thread sleeps when no blocks are queued.
+#define DEFRAG_IDLE_US 1000
+
+// Most ops a paced sync thread does back-to-back when it has fallen behind.
+#define MAX_PACED_BATCH 64
+
 #define SPLIT_RESOLUTION (1024 * 1024)
 
 #define LO_IO_MIN_SIZE 512
@@ -101,10 +173,17 @@ typedef struct trans_req_s {
 // Forward declarations.
 //
 
-static void* run_service(void* pv_unused);
+static void* run_service(void* pv_group);
 static void* run_large_block_reads(void* pv_dev);
 static void* run_large_block_writes(void* pv_dev);
+static void* run_buffered_writes(void* pv_dev);
 static void* run_tomb_raider(void* pv_dev);
+static void* run_defrag(void* pv_dev);
+static void* run_service_async(void* pv_group);
+static void* run_large_block_reads_async(void* pv_dev);
+static void* run_large_block_writes_async(void* pv_dev);
+static void* run_closed_loop(void* pv_dev);
+static void* run_closed_loop_async(void* pv_dev);
 
 static uint8_t* act_valloc(size_t size);
 static bool discover_device(device* dev);
@@ -114,16 +193,51 @@ static void discover_write_pattern(device* dev);
 static void fd_close_all(device* dev);
 static int fd_get(device* dev);
 static void fd_put(device* dev, int fd);
+static bool place_device(device* dev);
+static bool discover_hw_queues(device* dev);
+static const cpu_set_t* submit_cpus(const device* dev, uint32_t ix,
+		const thread_cfg* cfg, cpu_set_t* cpus);
+static void flush_write_buffer(device* dev, uint64_t offset, uint32_t size,
+		uint64_t sched_ns, bool is_full);
+static uint32_t max_reporting_threads();
 static void read_and_report(trans_req* read_req, uint8_t* buf);
-static void read_and_report_large_block(device* dev, uint8_t* buf);
+static void read_and_report_large_block(device* dev, uint8_t* buf,
+		uint64_t sched_ns);
 static uint64_t read_from_device(device* dev, uint64_t offset, uint32_t size,
 		uint8_t* buf);
-static void write_and_report(trans_req* write_req, uint8_t* buf);
-static void write_and_report_large_block(device* dev, uint8_t* buf,
-		uint64_t count);
+static void report_op(op_type type, device* dev, uint64_t sched_ns,
+		uint64_t start_ns, uint64_t stop_ns, uint32_t size);
+static void report_cache_hits();
+static void report_hw_queues();
+static void report_write_buffer();
+static bool set_svc_groups();
+static void write_and_report(trans_req* write_req);
+static void write_and_report_large_block(device* dev, uint64_t sched_ns);
 static uint64_t write_to_device(device* dev, uint64_t offset, uint32_t size,
 		const uint8_t* buf);
 
+static bool async_thread_init(async_thread* at, uint32_t buf_size,
+		uint32_t depth);
+static void async_thread_destroy(async_thread* at);
+static uint32_t max_trans_bytes();
+static void prep_large_block_read(io_op* op, void* pv_dev);
+static void prep_large_block_write(io_op* op, void* pv_dev);
+static void prep_read(io_op* op, device* dev);
+static void prep_service_op(io_op* op, void* pv_group);
+static void prep_write(io_op* op, device* dev);
+static void reap_and_report(async_thread* at, uint64_t timeout_us);
+static void report_async_op(io_op* op, uint64_t stop_ns);
+static void run_async_paced(async_thread* at, double ops_per_sec, prep_fn prep,
+		void* udata, const char* what);
+static bool submit_async_op(async_thread* at, prep_fn prep, void* udata,
+		uint64_t sched_ns);
+
+static uint32_t closed_loop_buf_bytes();
+static void do_sync_op(io_op* op);
+static void prep_closed_loop_op(io_op* op, void* pv_dev);
+static void report_throughput(uint64_t interval_us);
+static void set_closed_loop_splits();
+
 
 //==========================================================
 // Globals.
@@ -139,15 +253,47 @@ static histogram* g_large_block_write_hist;
 static histogram* g_read_hist;
 static histogram* g_write_hist;
 
+// Latency from intended start on each thread's schedule - if co-histograms.
+static histogram* g_co_large_block_read_hist;
+static histogram* g_co_large_block_write_hist;
+static histogram* g_co_read_hist;
+static histogram* g_co_write_hist;
+
+static svc_group g_svc_groups[MAX_NUM_STORAGE_DEVICES];
+static uint32_t g_n_svc_groups;
+static uint32_t g_n_svc_threads;    // total over all groups
+
+// Closed-loop mode op mix - cumulative thresholds out of SPLIT_RESOLUTION for
+// reads, writes and large-block reads. (The rest are large-block writes.)
+static uint64_t g_closed_loop_splits[3];
+
 
 //==========================================================
 // Inlines & macros.
 //
 
-static inline uint8_t*
-align_4096(const uint8_t* stack_buffer)
+// Where a device's threads run - NULL means anywhere.
+static inline const cpu_set_t*
+device_cpus(const device* dev)
 {
-	return (uint8_t*)(((uint64_t)stack_buffer + 4095) & ~4095ULL);
+	return dev->numa_node == -1 ? NULL : &dev->numa_cpus;
+}
+
+// Count an op about to be submitted, against the hardware queue that the CPU
+// we're on submits to.
+static inline void
+count_hw_queue_submit(device* dev)
+{
+	if (dev->n_hw_queue_submits == NULL) {
+		return;
+	}
+
+	int cpu = sched_getcpu();
+
+	if (cpu >= 0 && cpu < CPU_SETSIZE) {
+		__atomic_fetch_add(&dev->n_hw_queue_submits[dev->cpu_hw_queue[cpu]],
+				1, __ATOMIC_RELAXED);
+	}
 }
 
 static inline uint64_t
@@ -156,10 +302,97 @@ random_large_block_offset(const device* dev)
 	return (rand_64() % dev->n_large_blocks) * g_scfg.large_block_ops_bytes;
 }
 
+// Note a large block is written - it's now the newest in the post-write cache.
+static inline void
+cache_block(device* dev, uint64_t offset)
+{
+	if (dev->cache_seqs == NULL) {
+		return;
+	}
+
+	uint32_t seq = __atomic_add_fetch(&dev->write_seq, 1, __ATOMIC_RELAXED);
+
+	// Skip 0, which means never written.
+	if (seq == 0) {
+		seq = __atomic_add_fetch(&dev->write_seq, 1, __ATOMIC_RELAXED);
+	}
+
+	__atomic_store_n(&dev->cache_seqs[offset / g_scfg.large_block_ops_bytes],
+			seq, __ATOMIC_RELAXED);
+}
+
+static inline bool
+is_block_cached(const device* dev, uint64_t offset)
+{
+	uint32_t seq = __atomic_load_n(
+			&dev->cache_seqs[offset / g_scfg.large_block_ops_bytes],
+			__ATOMIC_RELAXED);
+	uint32_t write_seq = __atomic_load_n(&dev->write_seq, __ATOMIC_RELAXED);
+
+	// Unsigned difference is right across wrapping.
+	return seq != 0 && write_seq - seq < g_scfg.post_write_cache_blocks;
+}
+
+// Reads of recently written blocks are served from the post-write cache.
+static inline bool
+read_hits_cache(device* dev, uint64_t offset, uint32_t size)
+{
+	if (dev->cache_seqs == NULL) {
+		return false;
+	}
+
+	if (is_block_cached(dev, offset) &&
+			is_block_cached(dev, offset + size - 1)) {
+		__atomic_fetch_add(&dev->n_cache_hits, 1, __ATOMIC_RELAXED);
+		return true;
+	}
+
+	__atomic_fetch_add(&dev->n_cache_misses, 1, __ATOMIC_RELAXED);
+
+	return false;
+}
+
+// Large-block (defrag) reads come from written blocks if log-structured.
+static inline uint64_t
+large_block_read_offset(device* dev)
+{
+	if (! g_scfg.log_structured_writes) {
+		return random_large_block_offset(dev);
+	}
+
+	return (uint64_t)wblocks_defrag(&dev->wblocks) *
+			g_scfg.large_block_ops_bytes;
+}
+
+// Large-block writes go to free blocks in order if log-structured. With
+// stateful defrag, their records replace older copies.
+static inline uint64_t
+large_block_write_offset(device* dev)
+{
+	uint64_t offset;
+
+	if (! g_scfg.log_structured_writes) {
+		offset = random_large_block_offset(dev);
+	}
+	else {
+		if (g_scfg.stateful_defrag) {
+			wblocks_replace(&dev->wblocks, g_scfg.large_block_ops_bytes,
+					g_scfg.avg_record_stored_bytes);
+		}
+
+		offset = (uint64_t)wblocks_alloc(&dev->wblocks) *
+				g_scfg.large_block_ops_bytes;
+	}
+
+	cache_block(dev, offset);
+
+	return offset;
+}
+
 static inline uint64_t
 random_read_offset(const device* dev)
 {
-	return (rand_64() % dev->n_read_offsets) * dev->min_op_bytes;
+	return offset_dist_next(&dev->read_dist) * dev->min_op_bytes;
 }
 
 static inline uint32_t
@@ -197,6 +430,7 @@ safe_delta_ns(uint64_t start_ns, uint64_t stop_ns)
 }
 
 
+
 //==========================================================
 // Main.
 //
@@ -214,17 +448,53 @@ main(int argc, char* argv[])
 		exit(-1);
 	}
 
+	clock_init();
+
 	device devices[g_scfg.num_devices];
 
+	memset(devices, 0, sizeof(devices));
+
 	g_devices = devices;
 
-	histogram_scale scale =
-			g_scfg.us_histograms ? HIST_MICROSECONDS : HIST_MILLISECONDS;
+	histogram_scale scale = g_scfg.ns_histograms ? HIST_NANOSECONDS :
+			(g_scfg.us_histograms ? HIST_MICROSECONDS : HIST_MILLISECONDS);
+
+	// Histograms give each thread reporting ops a shard of its own.
+	uint32_t n_threads = max_reporting_threads();
+
+	if (! (g_large_block_read_hist = histogram_create(scale, n_threads)) ||
+		! (g_large_block_write_hist = histogram_create(scale, n_threads)) ||
+		! (g_read_hist = histogram_create(scale, n_threads)) ||
+		! (g_write_hist = histogram_create(scale, n_threads))) {
+		exit(-1);
+	}
+
+	if (g_scfg.co_histograms &&
+			(! (g_co_large_block_read_hist =
+					histogram_create(scale, n_threads)) ||
+			! (g_co_large_block_write_hist =
+					histogram_create(scale, n_threads)) ||
+			! (g_co_read_hist = histogram_create(scale, n_threads)) ||
+			! (g_co_write_hist = histogram_create(scale, n_threads)))) {
+		exit(-1);
+	}
+
+	uint32_t hdr_digits = g_scfg.hdr_significant_digits;
+
+	// Log-linear twins for the aggregate histograms only.
+	if (hdr_digits != 0 &&
+			(! histogram_add_hdr(g_large_block_read_hist, hdr_digits) ||
+			! histogram_add_hdr(g_large_block_write_hist, hdr_digits) ||
+			! histogram_add_hdr(g_read_hist, hdr_digits) ||
+			! histogram_add_hdr(g_write_hist, hdr_digits))) {
+		exit(-1);
+	}
 
-	if (! (g_large_block_read_hist = histogram_create(scale)) ||
-		! (g_large_block_write_hist = histogram_create(scale)) ||
-		! (g_read_hist = histogram_create(scale)) ||
-		! (g_write_hist = histogram_create(scale))) {
+	if (hdr_digits != 0 && g_scfg.co_histograms &&
+			(! histogram_add_hdr(g_co_large_block_read_hist, hdr_digits) ||
+			! histogram_add_hdr(g_co_large_block_write_hist, hdr_digits) ||
+			! histogram_add_hdr(g_co_read_hist, hdr_digits) ||
+			! histogram_add_hdr(g_co_write_hist, hdr_digits))) {
 		exit(-1);
 	}
 
@@ -235,8 +505,29 @@ main(int argc, char* argv[])
 
 		if (! (dev->fd_q = queue_create(sizeof(int))) ||
 			! discover_device(dev) ||
-			! (dev->read_hist = histogram_create(scale)) ||
-			! (dev->write_hist = histogram_create(scale))) {
+			! place_device(dev) ||
+			! discover_hw_queues(dev) ||
+			! (dev->read_hist = histogram_create(scale, n_threads)) ||
+			! (dev->write_hist = histogram_create(scale, n_threads))) {
+			exit(-1);
+		}
+
+		if (g_scfg.log_structured_writes &&
+				! wblocks_init(&dev->wblocks, dev->n_large_blocks)) {
+			exit(-1);
+		}
+
+		if (g_scfg.stateful_defrag &&
+				! wblocks_track_live(&dev->wblocks,
+						g_scfg.large_block_ops_bytes, g_scfg.defrag_lwm_pct,
+						g_scfg.live_data_pct)) {
+			exit(-1);
+		}
+
+		if (g_scfg.post_write_cache_blocks != 0 &&
+				! (dev->cache_seqs =
+						calloc(dev->n_large_blocks, sizeof(uint32_t)))) {
+			printf("ERROR: post-write cache state (calloc)\n");
 			exit(-1);
 		}
 
@@ -246,25 +537,60 @@ main(int argc, char* argv[])
 
 	rand_seed();
 
+	if (g_scfg.interval_log_file[0] != '\0' &&
+			! interval_log_open(g_scfg.interval_log_file,
+					g_scfg.interval_log_format, "ACT-STORAGE", argv[1],
+					g_scfg.report_interval_us)) {
+		exit(-1);
+	}
+
 	g_run_start_us = get_us();
 
 	uint64_t run_stop_us = g_run_start_us + g_scfg.run_us;
 
 	g_running = true;
 
-	if (g_scfg.write_reqs_per_sec != 0) {
+	bool is_async = g_scfg.io_engine != IO_ENGINE_SYNC;
+	bool is_closed_loop = g_scfg.closed_loop_qd != 0;
+
+	// In closed-loop mode, closed-loop threads do all the device ops.
+	bool do_large_blocks = ! is_closed_loop && g_scfg.write_reqs_per_sec != 0;
+
+	// With stateful defrag, the large-block read thread is a defrag thread
+	// that does both reads and writes - even if no-defrag-reads.
+	bool do_large_block_reads =
+			g_scfg.stateful_defrag || ! g_scfg.no_defrag_reads;
+
+	void* (*large_block_read_fn)(void*) = g_scfg.stateful_defrag ?
+			run_defrag :
+			(is_async ? run_large_block_reads_async : run_large_block_reads);
+
+	// Write buffers flush one at a time, so don't need an async engine.
+	void* (*large_block_write_fn)(void*) = g_scfg.flush_max_ms != 0 ?
+			run_buffered_writes :
+			(is_async ? run_large_block_writes_async : run_large_block_writes);
+
+	// For a device's threads' CPUs, if on one of its hardware queues.
+	cpu_set_t cpus;
+
+	if (do_large_blocks) {
 		for (uint32_t n = 0; n < g_scfg.num_devices; n++) {
 			device* dev = &g_devices[n];
 
-			if (! g_scfg.no_defrag_reads &&
-					pthread_create(&dev->large_block_read_thread, NULL,
-							run_large_block_reads, (void*)dev) != 0) {
+			if (do_large_block_reads &&
+					! thread_create(&dev->large_block_read_thread,
+							large_block_read_fn, (void*)dev,
+							&g_scfg.large_block_cpus,
+							submit_cpus(dev, 0, &g_scfg.large_block_cpus,
+									&cpus))) {
 				printf("ERROR: create large op read thread\n");
 				exit(-1);
 			}
 
-			if (pthread_create(&dev->large_block_write_thread, NULL,
-					run_large_block_writes, (void*)dev) != 0) {
+			if (! thread_create(&dev->large_block_write_thread,
+					large_block_write_fn, (void*)dev,
+					&g_scfg.large_block_cpus,
+					submit_cpus(dev, 1, &g_scfg.large_block_cpus, &cpus))) {
 				printf("ERROR: create large op write thread\n");
 				exit(-1);
 			}
@@ -275,8 +601,9 @@ main(int argc, char* argv[])
 		for (uint32_t n = 0; n < g_scfg.num_devices; n++) {
 			device* dev = &g_devices[n];
 
-			if (pthread_create(&dev->tomb_raider_thread, NULL,
-					run_tomb_raider, (void*)dev) != 0) {
+			if (! thread_create(&dev->tomb_raider_thread, run_tomb_raider,
+					(void*)dev, &g_scfg.tomb_raider_cpus,
+					submit_cpus(dev, 2, &g_scfg.tomb_raider_cpus, &cpus))) {
 				printf("ERROR: create tomb raider thread\n");
 				exit(-1);
 			}
@@ -284,21 +611,76 @@ main(int argc, char* argv[])
 	}
 
 	// Yes, it's ok to run with only large-block operations.
-	bool do_transactions =
+	bool do_transactions = ! is_closed_loop &&
 			g_scfg.internal_read_reqs_per_sec +
 			g_scfg.internal_write_reqs_per_sec != 0;
 
-	pthread_t svc_tids[g_scfg.service_threads];
+	if (do_transactions && ! set_svc_groups()) {
+		exit(-1);
+	}
+
+	pthread_t svc_tids[do_transactions ? g_n_svc_threads : 1];
+	uint32_t k = 0;
+
+	for (uint32_t g = 0; g < g_n_svc_groups; g++) {
+		svc_group* group = &g_svc_groups[g];
+
+		for (uint32_t j = 0; j < group->n_threads; j++) {
+			// Threads are assigned the group's devices in turn.
+			device* dev = group->devices[j % group->n_devices];
 
-	if (do_transactions) {
-		for (uint32_t k = 0; k < g_scfg.service_threads; k++) {
-			if (pthread_create(&svc_tids[k], NULL, run_service, NULL) != 0) {
+			// If placing on hardware queues, the thread's device's queues -
+			// typically all devices map CPUs to queues the same way.
+			const cpu_set_t* svc_cpus = g_scfg.hw_queue_placement ?
+					submit_cpus(dev, j / group->n_devices,
+							&g_scfg.service_cpus, &cpus) :
+					group->cpus;
+
+			if (! thread_create(&svc_tids[k++],
+					is_async ? run_service_async : run_service, (void*)group,
+					&g_scfg.service_cpus, svc_cpus)) {
 				printf("ERROR: create service thread\n");
 				exit(-1);
 			}
 		}
 	}
 
+	// Async engines keep the whole queue depth in flight from one thread per
+	// device, the sync engine needs a thread per op in flight.
+	uint32_t n_closed_loop_threads = is_async ? 1 : g_scfg.closed_loop_qd;
+
+	if (is_closed_loop) {
+		set_closed_loop_splits();
+
+		for (uint32_t n = 0; n < g_scfg.num_devices; n++) {
+			device* dev = &g_devices[n];
+
+			dev->closed_loop_threads =
+					malloc(n_closed_loop_threads * sizeof(pthread_t));
+
+			if (dev->closed_loop_threads == NULL) {
+				printf("ERROR: closed-loop threads (malloc)\n");
+				exit(-1);
+			}
+
+			for (uint32_t k = 0; k < n_closed_loop_threads; k++) {
+				if (! thread_create(&dev->closed_loop_threads[k],
+						is_async ? run_closed_loop_async : run_closed_loop,
+						(void*)dev, &g_scfg.closed_loop_cpus,
+						submit_cpus(dev, k, &g_scfg.closed_loop_cpus,
+								&cpus))) {
+					printf("ERROR: create closed-loop thread\n");
+					exit(-1);
+				}
+			}
+		}
+	}
+
+	// Only now, so worker threads don't inherit the reporter's placement.
+	if (! thread_place_self(&g_scfg.reporter_cpus)) {
+		exit(-1);
+	}
+
 	// Equivalent: g_scfg.internal_read_reqs_per_sec != 0.
 	bool do_reads = g_scfg.read_reqs_per_sec != 0;
 
@@ -313,11 +695,20 @@ main(int argc, char* argv[])
 		for (uint32_t d = 0; d < g_scfg.num_devices; d++) {
 			printf("%s\n", g_devices[d].read_hist_tag);
 		}
+
+		if (g_scfg.co_histograms) {
+			printf("co-reads\n");
+		}
 	}
 
 	if (g_scfg.write_reqs_per_sec != 0) {
 		printf("large-block-reads\n");
 		printf("large-block-writes\n");
+
+		if (g_scfg.co_histograms) {
+			printf("co-large-block-reads\n");
+			printf("co-large-block-writes\n");
+		}
 	}
 
 	if (do_commits) {
@@ -326,12 +717,17 @@ main(int argc, char* argv[])
 		for (uint32_t d = 0; d < g_scfg.num_devices; d++) {
 			printf("%s\n", g_devices[d].write_hist_tag);
 		}
+
+		if (g_scfg.co_histograms) {
+			printf("co-writes\n");
+		}
 	}
 
 	printf("\n");
 
 	uint64_t now_us = 0;
 	uint64_t count = 0;
+	uint64_t last_report_us = g_run_start_us;
 
 	while (g_running && (now_us = get_us()) < run_stop_us) {
 		count++;
@@ -347,6 +743,8 @@ main(int argc, char* argv[])
 		printf("after %" PRIu64 " sec:\n",
 				(count * g_scfg.report_interval_us) / 1000000);
 
+		interval_log_begin();
+
 		if (do_reads) {
 			histogram_dump(g_read_hist, "reads");
 
@@ -355,11 +753,22 @@ main(int argc, char* argv[])
 
 				histogram_dump(dev->read_hist, dev->read_hist_tag);
 			}
+
+			if (g_scfg.co_histograms) {
+				histogram_dump(g_co_read_hist, "co-reads");
+			}
 		}
 
 		if (g_scfg.write_reqs_per_sec != 0) {
 			histogram_dump(g_large_block_read_hist, "large-block-reads");
 			histogram_dump(g_large_block_write_hist, "large-block-writes");
+
+			if (g_scfg.co_histograms) {
+				histogram_dump(g_co_large_block_read_hist,
+						"co-large-block-reads");
+				histogram_dump(g_co_large_block_write_hist,
+						"co-large-block-writes");
+			}
 		}
 
 		if (do_commits) {
@@ -370,18 +779,43 @@ main(int argc, char* argv[])
 
 				histogram_dump(dev->write_hist, dev->write_hist_tag);
 			}
+
+			if (g_scfg.co_histograms) {
+				histogram_dump(g_co_write_hist, "co-writes");
+			}
+		}
+
+		if (do_large_blocks && g_scfg.flush_max_ms != 0) {
+			report_write_buffer();
 		}
 
+		if (do_reads && g_scfg.post_write_cache_blocks != 0) {
+			report_cache_hits();
+		}
+
+		if (g_scfg.hw_queue_stats) {
+			report_hw_queues();
+		}
+
+		if (is_closed_loop) {
+			uint64_t report_us = get_us();
+
+			report_throughput(report_us - last_report_us);
+			last_report_us = report_us;
+		}
+
+		interval_log_end();
+
 		printf("\n");
 		fflush(stdout);
 	}
 
 	g_running = false;
 
-	if (do_transactions) {
-		for (uint32_t k = 0; k < g_scfg.service_threads; k++) {
-			pthread_join(svc_tids[k], NULL);
-		}
+	interval_log_close();
+
+	for (uint32_t k = 0; k < g_n_svc_threads; k++) {
+		pthread_join(svc_tids[k], NULL);
 	}
 
 	for (uint32_t d = 0; d < g_scfg.num_devices; d++) {
@@ -391,21 +825,45 @@ main(int argc, char* argv[])
 			pthread_join(dev->tomb_raider_thread, NULL);
 		}
 
-		if (g_scfg.write_reqs_per_sec != 0) {
-			pthread_join(dev->large_block_read_thread, NULL);
+		if (do_large_blocks) {
+			if (do_large_block_reads) {
+				pthread_join(dev->large_block_read_thread, NULL);
+			}
+
 			pthread_join(dev->large_block_write_thread, NULL);
 		}
 
+		if (is_closed_loop) {
+			for (uint32_t k = 0; k < n_closed_loop_threads; k++) {
+				pthread_join(dev->closed_loop_threads[k], NULL);
+			}
+
+			free(dev->closed_loop_threads);
+		}
+
 		fd_close_all(dev);
 		queue_destroy(dev->fd_q);
-		free(dev->read_hist);
-		free(dev->write_hist);
+		histogram_destroy(dev->read_hist);
+		histogram_destroy(dev->write_hist);
+
+		if (g_scfg.log_structured_writes) {
+			wblocks_free(&dev->wblocks);
+		}
+
+		free(dev->cache_seqs);
+		free(dev->queue_cpus);
+		free(dev->cpu_hw_queue);
+		free(dev->n_hw_queue_submits);
 	}
 
-	free(g_large_block_read_hist);
-	free(g_large_block_write_hist);
-	free(g_read_hist);
-	free(g_write_hist);
+	histogram_destroy(g_large_block_read_hist);
+	histogram_destroy(g_large_block_write_hist);
+	histogram_destroy(g_read_hist);
+	histogram_destroy(g_write_hist);
+	histogram_destroy(g_co_large_block_read_hist);
+	histogram_destroy(g_co_large_block_write_hist);
+	histogram_destroy(g_co_read_hist);
+	histogram_destroy(g_co_write_hist);
 
 	return 0;
 }
@@ -420,61 +878,65 @@ main(int argc, char* argv[])
 // commit-to-device, writes.
 //
 static void*
-run_service(void* pv_unused)
+run_service(void* pv_group)
 {
 	rand_seed_thread();
 
-	uint64_t count = 0;
-
-	uint32_t total_reqs_per_sec =
-			g_scfg.internal_read_reqs_per_sec +
-			g_scfg.internal_write_reqs_per_sec;
-
-	uint32_t reqs_per_sec = total_reqs_per_sec / g_scfg.service_threads;
+	const svc_group* group = (const svc_group*)pv_group;
 
-	uint64_t read_split = (uint64_t)SPLIT_RESOLUTION *
-			g_scfg.internal_read_reqs_per_sec / total_reqs_per_sec;
+	buf_pool pool;
 
-	while (g_running) {
-		uint32_t random_dev_index = rand_32() % g_scfg.num_devices;
-		device* random_dev = &g_devices[random_dev_index];
+	if (! buf_pool_init(&pool, 1, max_trans_bytes())) {
+		g_running = false;
+		return NULL;
+	}
 
-		if (read_split > rand_64() % SPLIT_RESOLUTION) {
-			trans_req read_req = {
-					.dev = random_dev,
-					.offset = random_read_offset(random_dev),
-					.size = random_read_size(random_dev)
-			};
+	uint8_t* buf = buf_pool_get(&pool, 0);
 
-			uint8_t stack_buffer[read_req.size + 4096];
-			uint8_t* buf = align_4096(stack_buffer);
+	if (g_scfg.commit_to_device && ! payload_thread_init(max_trans_bytes(), 1,
+			g_scfg.compress_pct)) {
+		buf_pool_free(&pool);
+		g_running = false;
+		return NULL;
+	}
 
-			read_and_report(&read_req, buf);
-		}
-		else {
-			trans_req write_req = {
-					.dev = random_dev,
-					.offset = random_write_offset(random_dev),
-					.size = random_write_size(random_dev)
-			};
+	pacer pc;
 
-			uint8_t stack_buffer[write_req.size + 4096];
-			uint8_t* buf = align_4096(stack_buffer);
+	pacer_init(&pc, g_run_start_us * 1000, group->thread_reqs_per_sec,
+			g_scfg.arrival);
 
-			write_and_report(&write_req, buf);
+	while (g_running) {
+		uint64_t now_ns = pacer_wait(&pc);
+
+		for (uint32_t n = 0; n < MAX_PACED_BATCH && pacer_is_due(&pc, now_ns);
+				n++) {
+			uint32_t random_dev_index = rand_32() % group->n_devices;
+			device* random_dev = group->devices[random_dev_index];
+
+			if (group->read_split > rand_64() % SPLIT_RESOLUTION) {
+				trans_req read_req = {
+						.dev = random_dev,
+						.offset = random_read_offset(random_dev),
+						.size = random_read_size(random_dev),
+						.sched_ns = pacer_next(&pc)
+				};
+
+				read_and_report(&read_req, buf);
+			}
+			else {
+				trans_req write_req = {
+						.dev = random_dev,
+						.offset = random_write_offset(random_dev),
+						.size = random_write_size(random_dev),
+						.sched_ns = pacer_next(&pc)
+				};
+
+				write_and_report(&write_req);
+			}
 		}
 
-		count++;
-
-		int64_t sleep_us = (int64_t)
-				(((count * 1000000) / reqs_per_sec) -
-						(get_us() - g_run_start_us));
-
-		if (sleep_us > 0) {
-			usleep((uint32_t)sleep_us);
-		}
-		else if (g_scfg.max_lag_usec != 0 &&
-				sleep_us < -(int64_t)g_scfg.max_lag_usec) {
+		if (g_scfg.max_lag_usec != 0 && pacer_lag_ns(&pc, get_ns()) >
+				(int64_t)g_scfg.max_lag_usec * 1000) {
 			printf("ERROR: service thread can't keep up\n");
 			printf("ACT can't do requested load - test stopped\n");
 			printf("try configuring more 'service-threads'\n");
@@ -482,6 +944,9 @@ run_service(void* pv_unused)
 		}
 	}
 
+	payload_thread_free();
+	buf_pool_free(&pool);
+
 	return NULL;
 }
 
@@ -504,24 +969,22 @@ run_large_block_reads(void* pv_dev)
 		return NULL;
 	}
 
-	uint64_t count = 0;
-
-	while (g_running) {
-		read_and_report_large_block(dev, buf);
-
-		count++;
+	pacer pc;
 
-		uint64_t target_us = (uint64_t)
-				((double)(count * 1000000 * g_scfg.num_devices) /
-						g_scfg.large_block_reads_per_sec);
+	pacer_init(&pc, g_run_start_us * 1000,
+			g_scfg.large_block_reads_per_sec / g_scfg.num_devices,
+			ARRIVAL_UNIFORM);
 
-		int64_t sleep_us = (int64_t)(target_us - (get_us() - g_run_start_us));
+	while (g_running) {
+		uint64_t now_ns = pacer_wait(&pc);
 
-		if (sleep_us > 0) {
-			usleep((uint32_t)sleep_us);
+		for (uint32_t n = 0; n < MAX_PACED_BATCH && pacer_is_due(&pc, now_ns);
+				n++) {
+			read_and_report_large_block(dev, buf, pacer_next(&pc));
 		}
-		else if (g_scfg.max_lag_usec != 0 &&
-				sleep_us < -(int64_t)g_scfg.max_lag_usec) {
+
+		if (g_scfg.max_lag_usec != 0 && pacer_lag_ns(&pc, get_ns()) >
+				(int64_t)g_scfg.max_lag_usec * 1000) {
 			printf("ERROR: large block reads can't keep up\n");
 			printf("drive(s) can't keep up - test stopped\n");
 			g_running = false;
@@ -544,39 +1007,121 @@ run_large_block_writes(void* pv_dev)
 
 	device* dev = (device*)pv_dev;
 
-	uint8_t* buf = act_valloc(g_scfg.large_block_ops_bytes);
+	if (! payload_thread_init(g_scfg.large_block_ops_bytes, 1,
+			g_scfg.compress_pct)) {
+		g_running = false;
+		return NULL;
+	}
 
-	if (buf == NULL) {
-		printf("ERROR: large block write buffer act_valloc()\n");
+	pacer pc;
+
+	pacer_init(&pc, g_run_start_us * 1000,
+			g_scfg.large_block_writes_per_sec / g_scfg.num_devices,
+			ARRIVAL_UNIFORM);
+
+	while (g_running) {
+		uint64_t now_ns = pacer_wait(&pc);
+
+		for (uint32_t n = 0; n < MAX_PACED_BATCH && pacer_is_due(&pc, now_ns);
+				n++) {
+			write_and_report_large_block(dev, pacer_next(&pc));
+		}
+
+		if (g_scfg.max_lag_usec != 0 && pacer_lag_ns(&pc, get_ns()) >
+				(int64_t)g_scfg.max_lag_usec * 1000) {
+			printf("ERROR: large block writes can't keep up\n");
+			printf("drive(s) can't keep up - test stopped\n");
+			g_running = false;
+		}
+	}
+
+	payload_thread_free();
+
+	return NULL;
+}
+
+//------------------------------------------------
+// Runs in every device large-block write thread
+// if flush-max-ms - fills a write buffer at the
+// large-block write rate, and flushes it when
+// full, or partly full if flush-max-ms passes
+// first. Partial flushes rewrite the block from
+// its start.
+//
+static void*
+run_buffered_writes(void* pv_dev)
+{
+	rand_seed_thread();
+
+	device* dev = (device*)pv_dev;
+	uint32_t block_bytes = g_scfg.large_block_ops_bytes;
+
+	if (! payload_thread_init(block_bytes, 1, g_scfg.compress_pct)) {
 		g_running = false;
 		return NULL;
 	}
 
-	uint64_t count = 0;
+	double blocks_per_sec =
+			g_scfg.large_block_writes_per_sec / g_scfg.num_devices;
+	double flushes_per_sec = 1000.0 / g_scfg.flush_max_ms;
+	double fill_ns = 1000000000.0 / blocks_per_sec;
+
+	uint64_t buf_start_ns = g_run_start_us * 1000;
+	uint64_t offset = large_block_write_offset(dev);
+
+	pacer full_pc; // when each buffer fills
+	pacer timer_pc; // flush-max-ms timer, restarted with each buffer
+
+	pacer_init(&full_pc, buf_start_ns, blocks_per_sec, ARRIVAL_UNIFORM);
+	pacer_next(&full_pc);
+
+	pacer_init(&timer_pc, buf_start_ns, flushes_per_sec, ARRIVAL_UNIFORM);
+	pacer_next(&timer_pc);
 
 	while (g_running) {
-		write_and_report_large_block(dev, buf, count);
+		if (pacer_sched_ns(&full_pc) <= pacer_sched_ns(&timer_pc)) {
+			pacer_wait(&full_pc);
 
-		count++;
+			uint64_t sched_ns = pacer_next(&full_pc);
 
-		uint64_t target_us = (uint64_t)
-				((double)(count * 1000000 * g_scfg.num_devices) /
-						g_scfg.large_block_writes_per_sec);
+			flush_write_buffer(dev, offset, block_bytes, sched_ns, true);
 
-		int64_t sleep_us = (int64_t)(target_us - (get_us() - g_run_start_us));
+			buf_start_ns = sched_ns;
+			offset = large_block_write_offset(dev);
 
-		if (sleep_us > 0) {
-			usleep((uint32_t)sleep_us);
+			pacer_init(&timer_pc, buf_start_ns, flushes_per_sec,
+					ARRIVAL_UNIFORM);
+			pacer_next(&timer_pc);
+		}
+		else {
+			pacer_wait(&timer_pc);
+
+			uint64_t sched_ns = pacer_next(&timer_pc);
+			uint64_t fill_bytes = (uint64_t)((double)block_bytes *
+					(double)(sched_ns - buf_start_ns) / fill_ns);
+			uint32_t min_bytes = dev->min_op_bytes;
+			uint32_t size = (uint32_t)(((fill_bytes + min_bytes - 1) /
+					min_bytes) * min_bytes);
+
+			if (size == 0) {
+				size = min_bytes;
+			}
+			else if (size > block_bytes) {
+				size = block_bytes;
+			}
+
+			flush_write_buffer(dev, offset, size, sched_ns, false);
 		}
-		else if (g_scfg.max_lag_usec != 0 &&
-				sleep_us < -(int64_t)g_scfg.max_lag_usec) {
+
+		if (g_scfg.max_lag_usec != 0 && pacer_lag_ns(&full_pc, get_ns()) >
+				(int64_t)g_scfg.max_lag_usec * 1000) {
 			printf("ERROR: large block writes can't keep up\n");
 			printf("drive(s) can't keep up - test stopped\n");
 			g_running = false;
 		}
 	}
 
-	free(buf);
+	payload_thread_free();
 
 	return NULL;
 }
@@ -620,33 +1165,291 @@ run_tomb_raider(void* pv_dev)
 	return NULL;
 }
 
-
-//==========================================================
-// Local helpers - generic.
-//
-
 //------------------------------------------------
-// Aligned memory allocation.
+// Runs in every device defrag thread if stateful
+// defrag - reads blocks as they are queued, and
+// rewrites their live data in full blocks.
 //
-static uint8_t*
-act_valloc(size_t size)
+static void*
+run_defrag(void* pv_dev)
 {
-	void* pv;
-
-	return posix_memalign(&pv, 4096, size) == 0 ? (uint8_t*)pv : 0;
-}
+	rand_seed_thread();
 
-//------------------------------------------------
-// Discover device storage capacity, etc.
-//
-static bool
-discover_device(device* dev)
-{
-	int fd = fd_get(dev);
+	device* dev = (device*)pv_dev;
+	uint32_t block_bytes = g_scfg.large_block_ops_bytes;
 
-	if (fd == -1) {
-		return false;
-	}
+	uint8_t* buf = act_valloc(block_bytes);
+
+	if (buf == NULL) {
+		printf("ERROR: defrag buffer act_valloc()\n");
+		g_running = false;
+		return NULL;
+	}
+
+	if (! payload_thread_init(block_bytes, 1, g_scfg.compress_pct)) {
+		free(buf);
+		g_running = false;
+		return NULL;
+	}
+
+	// Live data read but not yet rewritten.
+	uint64_t pending_bytes = 0;
+
+	while (g_running) {
+		uint32_t id;
+		uint32_t live_bytes;
+
+		if (! wblocks_defrag_pop(&dev->wblocks, &id, &live_bytes)) {
+			usleep(DEFRAG_IDLE_US);
+			continue;
+		}
+
+		if (! g_scfg.no_defrag_reads) {
+			uint64_t start_ns = get_ns();
+			uint64_t stop_ns = read_from_device(dev,
+					(uint64_t)id * block_bytes, block_bytes, buf);
+
+			if (stop_ns != -1) {
+				report_op(OP_LARGE_BLOCK_READ, dev, start_ns, start_ns,
+						stop_ns, block_bytes);
+			}
+		}
+
+		pending_bytes += live_bytes;
+
+		while (pending_bytes >= block_bytes && g_running) {
+			const uint8_t* data = payload_next(0, block_bytes);
+			uint64_t offset = (uint64_t)wblocks_alloc(&dev->wblocks) *
+					block_bytes;
+
+			cache_block(dev, offset);
+			uint64_t start_ns = get_ns();
+			uint64_t stop_ns = write_to_device(dev, offset, block_bytes, data);
+
+			if (stop_ns != -1) {
+				report_op(OP_LARGE_BLOCK_WRITE, dev, start_ns, start_ns,
+						stop_ns, block_bytes);
+			}
+
+			pending_bytes -= block_bytes;
+		}
+
+		wblocks_defrag_done(&dev->wblocks, id);
+	}
+
+	payload_thread_free();
+	free(buf);
+
+	return NULL;
+}
+
+//------------------------------------------------
+// Service threads for asynchronous io engines -
+// generate reads, and if commit-to-device,
+// writes, keeping up to io-depth in flight.
+//
+static void*
+run_service_async(void* pv_group)
+{
+	rand_seed_thread();
+
+	async_thread at;
+
+	if (! async_thread_init(&at, max_trans_bytes(), g_scfg.io_depth)) {
+		g_running = false;
+		return NULL;
+	}
+
+	if (g_scfg.commit_to_device && ! payload_thread_init(max_trans_bytes(),
+			g_scfg.io_depth, g_scfg.compress_pct)) {
+		async_thread_destroy(&at);
+		g_running = false;
+		return NULL;
+	}
+
+	const svc_group* group = (const svc_group*)pv_group;
+
+	run_async_paced(&at, group->thread_reqs_per_sec, prep_service_op,
+			pv_group, "service thread");
+
+	payload_thread_free();
+	async_thread_destroy(&at);
+
+	return NULL;
+}
+
+//------------------------------------------------
+// Device large-block read thread for asynchronous
+// io engines.
+//
+static void*
+run_large_block_reads_async(void* pv_dev)
+{
+	rand_seed_thread();
+
+	async_thread at;
+
+	if (! async_thread_init(&at, g_scfg.large_block_ops_bytes,
+			g_scfg.io_depth)) {
+		g_running = false;
+		return NULL;
+	}
+
+	run_async_paced(&at,
+			g_scfg.large_block_reads_per_sec / g_scfg.num_devices,
+			prep_large_block_read, pv_dev, "large block reads");
+
+	async_thread_destroy(&at);
+
+	return NULL;
+}
+
+//------------------------------------------------
+// Device large-block write thread for
+// asynchronous io engines.
+//
+static void*
+run_large_block_writes_async(void* pv_dev)
+{
+	rand_seed_thread();
+
+	async_thread at;
+
+	// Writes only - ops' data comes from the payload ring, not a buffer pool.
+	if (! async_thread_init(&at, 0, g_scfg.io_depth)) {
+		g_running = false;
+		return NULL;
+	}
+
+	if (! payload_thread_init(g_scfg.large_block_ops_bytes, g_scfg.io_depth,
+			g_scfg.compress_pct)) {
+		async_thread_destroy(&at);
+		g_running = false;
+		return NULL;
+	}
+
+	run_async_paced(&at,
+			g_scfg.large_block_writes_per_sec / g_scfg.num_devices,
+			prep_large_block_write, pv_dev, "large block writes");
+
+	payload_thread_free();
+	async_thread_destroy(&at);
+
+	return NULL;
+}
+
+//------------------------------------------------
+// Closed-loop threads for the sync io engine -
+// closed-loop-queue-depth of these per device,
+// each doing one op after another, no pacing.
+//
+static void*
+run_closed_loop(void* pv_dev)
+{
+	rand_seed_thread();
+
+	buf_pool pool;
+
+	if (! buf_pool_init(&pool, 1, closed_loop_buf_bytes())) {
+		g_running = false;
+		return NULL;
+	}
+
+	if (! payload_thread_init(closed_loop_buf_bytes(), 1,
+			g_scfg.compress_pct)) {
+		buf_pool_free(&pool);
+		g_running = false;
+		return NULL;
+	}
+
+	io_op op = { 0 };
+
+	while (g_running) {
+		// Writes replace the buffer with payload data.
+		op.buf = buf_pool_get(&pool, 0);
+		prep_closed_loop_op(&op, pv_dev);
+		do_sync_op(&op);
+	}
+
+	payload_thread_free();
+	buf_pool_free(&pool);
+
+	return NULL;
+}
+
+//------------------------------------------------
+// Closed-loop thread for asynchronous io engines -
+// one per device, keeping closed-loop-queue-depth
+// ops in flight, no pacing.
+//
+static void*
+run_closed_loop_async(void* pv_dev)
+{
+	rand_seed_thread();
+
+	async_thread at;
+
+	if (! async_thread_init(&at, closed_loop_buf_bytes(),
+			g_scfg.closed_loop_qd)) {
+		g_running = false;
+		return NULL;
+	}
+
+	if (! payload_thread_init(closed_loop_buf_bytes(), g_scfg.closed_loop_qd,
+			g_scfg.compress_pct)) {
+		async_thread_destroy(&at);
+		g_running = false;
+		return NULL;
+	}
+
+	while (g_running) {
+		// Refill every completed slot. (Stop early if an op fails to submit,
+		// its slot will be retried after the next reap.)
+		while (at.n_free != 0 &&
+				submit_async_op(&at, prep_closed_loop_op, pv_dev, 0)) {
+			;
+		}
+
+		reap_and_report(&at, REAP_WAIT_US);
+	}
+
+	while (async_io_in_flight(at.aio) != 0) {
+		reap_and_report(&at, REAP_WAIT_US);
+	}
+
+	payload_thread_free();
+	async_thread_destroy(&at);
+
+	return NULL;
+}
+
+
+//==========================================================
+// Local helpers - generic.
+//
+
+//------------------------------------------------
+// Aligned memory allocation.
+//
+static uint8_t*
+act_valloc(size_t size)
+{
+	void* pv;
+
+	return posix_memalign(&pv, 4096, size) == 0 ? (uint8_t*)pv : 0;
+}
+
+//------------------------------------------------
+// Discover device storage capacity, etc.
+//
+static bool
+discover_device(device* dev)
+{
+	int fd = fd_get(dev);
+
+	if (fd == -1) {
+		return false;
+	}
 
 	uint64_t device_bytes = 0;
 
@@ -756,6 +1559,8 @@ discover_read_pattern(device* dev)
 	// Total number of sites on device to read from. (Make sure the last site
 	// has room for largest possible read request.)
 	dev->n_read_offsets = n_min_op_blocks - read_req_min_op_blocks_rmx + 1;
+
+	offset_dist_init(&dev->read_dist, dev->n_read_offsets, &g_scfg.read_dist);
 }
 
 //------------------------------------------------
@@ -838,129 +1643,1002 @@ fd_put(device* dev, int fd)
 }
 
 //------------------------------------------------
-// Do one transaction read operation and report.
+// Flush a write buffer - all of it, or the part
+// filled so far - and report.
 //
 static void
-read_and_report(trans_req* read_req, uint8_t* buf)
+flush_write_buffer(device* dev, uint64_t offset, uint32_t size,
+		uint64_t sched_ns, bool is_full)
 {
+	// Each flush gets freshly salted data.
+	const uint8_t* buf = payload_next(0, size);
+
 	uint64_t start_time = get_ns();
-	uint64_t stop_time = read_from_device(read_req->dev, read_req->offset,
-			read_req->size, buf);
+	uint64_t stop_time = write_to_device(dev, offset, size, buf);
 
 	if (stop_time != -1) {
-		histogram_insert_data_point(g_read_hist,
-				safe_delta_ns(start_time, stop_time));
-		histogram_insert_data_point(read_req->dev->read_hist,
-				safe_delta_ns(start_time, stop_time));
+		report_op(OP_LARGE_BLOCK_WRITE, dev, sched_ns, start_time, stop_time,
+				size);
+	}
+
+	if (is_full) {
+		__atomic_fetch_add(&dev->n_full_flushes, 1, __ATOMIC_RELAXED);
+	}
+	else {
+		__atomic_fetch_add(&dev->n_partial_flushes, 1, __ATOMIC_RELAXED);
+		__atomic_fetch_add(&dev->n_partial_bytes, size, __ATOMIC_RELAXED);
 	}
 }
 
 //------------------------------------------------
-// Do one large block read operation and report.
+// If numa-placement, find the NUMA node a device
+// is attached to, and the CPUs there this process
+// may use.
 //
-static void
-read_and_report_large_block(device* dev, uint8_t* buf)
+static bool
+place_device(device* dev)
 {
-	uint64_t offset = random_large_block_offset(dev);
-	uint64_t start_time = get_ns();
-	uint64_t stop_time = read_from_device(dev, offset,
-			g_scfg.large_block_ops_bytes, buf);
+	dev->numa_node = -1;
 
-	if (stop_time != -1) {
-		histogram_insert_data_point(g_large_block_read_hist,
-				safe_delta_ns(start_time, stop_time));
+	if (! g_scfg.numa_placement) {
+		return true;
 	}
-}
 
-//------------------------------------------------
-// Do one device read operation.
-//
-static uint64_t
-read_from_device(device* dev, uint64_t offset, uint32_t size, uint8_t* buf)
-{
-	int fd = fd_get(dev);
+	int32_t node = device_numa_node(dev->name);
 
-	if (fd == -1) {
-		return -1;
+	if (node == -1) {
+		printf("%s NUMA node unknown - not placed\n", dev->name);
+		return true;
 	}
 
-	if (! pread_all(fd, buf, size, offset)) {
-		close(fd);
-		printf("ERROR: reading %s: %d '%s'\n", dev->name, errno,
-				act_strerror(errno));
-		return -1;
+	const cpu_topology* topo = cpu_topology_get();
+
+	if (topo == NULL) {
+		return false;
 	}
 
-	uint64_t stop_ns = get_ns();
+	CPU_ZERO(&dev->numa_cpus);
 
-	fd_put(dev, fd);
+	if (node < MAX_NUM_NUMA_NODES) {
+		CPU_AND(&dev->numa_cpus, &topo->node_cpus[node], &topo->usable_cpus);
+	}
 
-	return stop_ns;
-}
+	if (CPU_COUNT(&dev->numa_cpus) == 0) {
+		printf("%s on NUMA node %d, no usable CPUs there - not placed\n",
+				dev->name, node);
+		return true;
+	}
 
-//------------------------------------------------
-// Do one transaction write operation and report.
-//
-static void
-write_and_report(trans_req* write_req, uint8_t* buf)
-{
-	// Salt each record.
-	rand_fill(buf, write_req->size, g_scfg.compress_pct);
+	dev->numa_node = node;
 
-	uint64_t start_time = get_ns();
-	uint64_t stop_time = write_to_device(write_req->dev, write_req->offset,
-			write_req->size, buf);
+	printf("%s on NUMA node %d, %d CPUs\n", dev->name, node,
+			CPU_COUNT(&dev->numa_cpus));
 
-	if (stop_time != -1) {
-		histogram_insert_data_point(g_write_hist,
-				safe_delta_ns(start_time, stop_time));
-		histogram_insert_data_point(write_req->dev->write_hist,
-				safe_delta_ns(start_time, stop_time));
-	}
+	return true;
 }
 
 //------------------------------------------------
-// Do one large block write operation and report.
+// Find a device's blk-mq hardware queues, for
+// hw-queue-placement and hw-queue-stats.
 //
-static void
-write_and_report_large_block(device* dev, uint8_t* buf, uint64_t count)
+static bool
+discover_hw_queues(device* dev)
 {
-	// Salt the block each time.
-	rand_fill(buf, g_scfg.large_block_ops_bytes, g_scfg.compress_pct);
+	if (! g_scfg.hw_queue_placement && ! g_scfg.hw_queue_stats) {
+		return true;
+	}
 
-	uint64_t offset = random_large_block_offset(dev);
-	uint64_t start_time = get_ns();
-	uint64_t stop_time = write_to_device(dev, offset,
-			g_scfg.large_block_ops_bytes, buf);
+	// Only used from main thread.
+	static hw_queue queues[MAX_NUM_HW_QUEUES];
 
-	if (stop_time != -1) {
-		histogram_insert_data_point(g_large_block_write_hist,
-				safe_delta_ns(start_time, stop_time));
+	uint32_t n_queues = device_hw_queues(dev->name, queues,
+			MAX_NUM_HW_QUEUES);
+
+	if (n_queues == 0) {
+		printf("%s hardware queues unknown\n", dev->name);
+		return true;
 	}
-}
 
-//------------------------------------------------
-// Do one device write operation.
-//
-static uint64_t
-write_to_device(device* dev, uint64_t offset, uint32_t size, const uint8_t* buf)
-{
-	int fd = fd_get(dev);
+	const cpu_topology* topo = cpu_topology_get();
 
-	if (fd == -1) {
-		return -1;
+	if (topo == NULL) {
+		return false;
 	}
 
-	if (! pwrite_all(fd, buf, size, offset)) {
-		close(fd);
-		printf("ERROR: writing %s: %d '%s'\n", dev->name, errno,
-				act_strerror(errno));
-		return -1;
+	dev->queue_cpus = malloc(n_queues * sizeof(cpu_set_t));
+
+	if (dev->queue_cpus == NULL) {
+		printf("ERROR: hardware queue CPUs (malloc)\n");
+		return false;
 	}
 
-	uint64_t stop_ns = get_ns();
+	if (g_scfg.hw_queue_stats) {
+		dev->n_hw_queues = n_queues;
+		dev->cpu_hw_queue = calloc(CPU_SETSIZE, sizeof(uint16_t));
+		dev->n_hw_queue_submits = calloc(n_queues, sizeof(uint64_t));
 
-	fd_put(dev, fd);
+		if (dev->cpu_hw_queue == NULL || dev->n_hw_queue_submits == NULL) {
+			printf("ERROR: hardware queue stats (calloc)\n");
+			return false;
+		}
+	}
 
-	return stop_ns;
+	printf("%s has %" PRIu32 " hardware queues\n", dev->name, n_queues);
+
+	const cpu_set_t* dev_cpus = device_cpus(dev);
+
+	for (uint32_t q = 0; q < n_queues; q++) {
+		const hw_queue* queue = &queues[q];
+		char cpus_str[MAX_CPU_LIST_SIZE];
+		char irq_cpus_str[MAX_CPU_LIST_SIZE];
+
+		cpu_list_to_string(&queue->cpus, cpus_str, sizeof(cpus_str));
+		cpu_list_to_string(&queue->irq_cpus, irq_cpus_str,
+				sizeof(irq_cpus_str));
+
+		printf("  queue %" PRIu32 " CPUs %s, interrupt CPUs %s\n", q,
+				cpus_str, CPU_COUNT(&queue->irq_cpus) == 0 ?
+						"unknown" : irq_cpus_str);
+
+		if (dev->cpu_hw_queue != NULL) {
+			for (uint32_t i = 0; i < CPU_SETSIZE; i++) {
+				if (CPU_ISSET(i, &queue->cpus)) {
+					dev->cpu_hw_queue[i] = (uint16_t)q;
+				}
+			}
+		}
+
+		// Only queues we may submit from are used for placement.
+		cpu_set_t* usable = &dev->queue_cpus[dev->n_queue_cpus];
+
+		CPU_AND(usable, &queue->cpus, &topo->usable_cpus);
+
+		if (dev_cpus != NULL) {
+			CPU_AND(usable, usable, dev_cpus);
+		}
+
+		if (CPU_COUNT(usable) != 0) {
+			dev->n_queue_cpus++;
+		}
+	}
+
+	return true;
+}
+
+//------------------------------------------------
+// Get the CPUs for the ix'th thread of a class to
+// submit to a device from. If hw-queue-placement,
+// threads are spread in turn over the device's
+// hardware queues whose CPUs the class may use.
+// Otherwise, or if there are none, the device's
+// CPUs (NULL if not placed).
+//
+static const cpu_set_t*
+submit_cpus(const device* dev, uint32_t ix, const thread_cfg* cfg,
+		cpu_set_t* cpus)
+{
+	if (! g_scfg.hw_queue_placement) {
+		return device_cpus(dev);
+	}
+
+	uint32_t n_allowed = 0;
+
+	for (uint32_t pass = 0; pass < 2; pass++) {
+		for (uint32_t q = 0; q < dev->n_queue_cpus; q++) {
+			const cpu_set_t* queue_cpus = &dev->queue_cpus[q];
+
+			if (cfg->is_pinned) {
+				CPU_AND(cpus, queue_cpus, &cfg->cpus);
+
+				if (CPU_COUNT(cpus) == 0) {
+					continue;
+				}
+			}
+
+			// First pass counts allowed queues, second picks one.
+			if (pass == 0) {
+				n_allowed++;
+			}
+			else if (ix-- == 0) {
+				CPU_ZERO(cpus);
+				CPU_OR(cpus, cpus, queue_cpus);
+				return cpus;
+			}
+		}
+
+		if (n_allowed == 0) {
+			return device_cpus(dev);
+		}
+
+		ix %= n_allowed;
+	}
+
+	return device_cpus(dev); // not reached
+}
+
+//------------------------------------------------
+// Do one transaction read operation and report.
+//
+static void
+read_and_report(trans_req* read_req, uint8_t* buf)
+{
+	if (read_hits_cache(read_req->dev, read_req->offset, read_req->size)) {
+		return;
+	}
+
+	uint64_t start_time = get_ns();
+	uint64_t stop_time = read_from_device(read_req->dev, read_req->offset,
+			read_req->size, buf);
+
+	if (stop_time != -1) {
+		report_op(OP_READ, read_req->dev, read_req->sched_ns, start_time,
+				stop_time, read_req->size);
+	}
+}
+
+//------------------------------------------------
+// Do one large block read operation and report.
+//
+static void
+read_and_report_large_block(device* dev, uint8_t* buf, uint64_t sched_ns)
+{
+	uint64_t offset = large_block_read_offset(dev);
+	uint64_t start_time = get_ns();
+	uint64_t stop_time = read_from_device(dev, offset,
+			g_scfg.large_block_ops_bytes, buf);
+
+	if (stop_time != -1) {
+		report_op(OP_LARGE_BLOCK_READ, dev, sched_ns, start_time, stop_time,
+				g_scfg.large_block_ops_bytes);
+	}
+}
+
+//------------------------------------------------
+// Do one device read operation.
+//
+static uint64_t
+read_from_device(device* dev, uint64_t offset, uint32_t size, uint8_t* buf)
+{
+	int fd = fd_get(dev);
+
+	if (fd == -1) {
+		return -1;
+	}
+
+	count_hw_queue_submit(dev);
+
+	if (! pread_all(fd, buf, size, offset)) {
+		close(fd);
+		printf("ERROR: reading %s: %d '%s'\n", dev->name, errno,
+				act_strerror(errno));
+		return -1;
+	}
+
+	uint64_t stop_ns = get_ns();
+
+	fd_put(dev, fd);
+
+	return stop_ns;
+}
+
+//------------------------------------------------
+// Insert a completed op's latency in the relevant
+// histograms, and in closed-loop mode, count it.
+// If co-histograms, also insert latency measured
+// from when the op was scheduled to start. (Ops
+// started early use their actual start instead.)
+//
+static void
+report_op(op_type type, device* dev, uint64_t sched_ns, uint64_t start_ns,
+		uint64_t stop_ns, uint32_t size)
+{
+	uint64_t delta_ns = safe_delta_ns(start_ns, stop_ns);
+
+	switch (type) {
+	case OP_READ:
+		histogram_insert_data_point(g_read_hist, delta_ns);
+		histogram_insert_data_point(dev->read_hist, delta_ns);
+		break;
+	case OP_WRITE:
+		histogram_insert_data_point(g_write_hist, delta_ns);
+		histogram_insert_data_point(dev->write_hist, delta_ns);
+		break;
+	case OP_LARGE_BLOCK_READ:
+		histogram_insert_data_point(g_large_block_read_hist, delta_ns);
+		break;
+	case OP_LARGE_BLOCK_WRITE:
+		histogram_insert_data_point(g_large_block_write_hist, delta_ns);
+		break;
+	}
+
+	if (g_scfg.closed_loop_qd != 0) {
+		__atomic_fetch_add(&dev->n_ops, 1, __ATOMIC_RELAXED);
+		__atomic_fetch_add(&dev->n_bytes, size, __ATOMIC_RELAXED);
+	}
+
+	if (! g_scfg.co_histograms) {
+		return;
+	}
+
+	uint64_t co_delta_ns =
+			safe_delta_ns(sched_ns < start_ns ? sched_ns : start_ns, stop_ns);
+
+	switch (type) {
+	case OP_READ:
+		histogram_insert_data_point(g_co_read_hist, co_delta_ns);
+		break;
+	case OP_WRITE:
+		histogram_insert_data_point(g_co_write_hist, co_delta_ns);
+		break;
+	case OP_LARGE_BLOCK_READ:
+		histogram_insert_data_point(g_co_large_block_read_hist, co_delta_ns);
+		break;
+	case OP_LARGE_BLOCK_WRITE:
+		histogram_insert_data_point(g_co_large_block_write_hist, co_delta_ns);
+		break;
+	}
+}
+
+//------------------------------------------------
+// Print post-write cache hits since the last
+// report.
+//
+static void
+report_cache_hits()
+{
+	uint64_t n_hits = 0;
+	uint64_t n_reads = 0;
+
+	for (uint32_t d = 0; d < g_scfg.num_devices; d++) {
+		device* dev = &g_devices[d];
+		uint64_t n_dev_hits = __atomic_exchange_n(&dev->n_cache_hits, 0,
+				__ATOMIC_RELAXED);
+
+		n_hits += n_dev_hits;
+		n_reads += n_dev_hits + __atomic_exchange_n(&dev->n_cache_misses, 0,
+				__ATOMIC_RELAXED);
+	}
+
+	printf("post-write-cache-hits: %" PRIu64 " of %" PRIu64 " reads, "
+			"%.2lf%%\n", n_hits, n_reads,
+			n_reads == 0 ? 0.0 : (double)n_hits * 100 / n_reads);
+}
+
+//------------------------------------------------
+// Print each device's submissions per hardware
+// queue since the last report.
+//
+static void
+report_hw_queues()
+{
+	for (uint32_t d = 0; d < g_scfg.num_devices; d++) {
+		device* dev = &g_devices[d];
+
+		if (dev->n_hw_queue_submits == NULL) {
+			continue;
+		}
+
+		printf("hw-queue-submits: %s", dev->name);
+
+		for (uint32_t q = 0; q < dev->n_hw_queues; q++) {
+			printf(" %" PRIu64, __atomic_exchange_n(
+					&dev->n_hw_queue_submits[q], 0, __ATOMIC_RELAXED));
+		}
+
+		printf("\n");
+	}
+}
+
+//------------------------------------------------
+// Print write buffer flush counts and sizes since
+// the last report.
+//
+static void
+report_write_buffer()
+{
+	uint64_t n_full = 0;
+	uint64_t n_partial = 0;
+	uint64_t partial_bytes = 0;
+
+	for (uint32_t d = 0; d < g_scfg.num_devices; d++) {
+		device* dev = &g_devices[d];
+
+		n_full += __atomic_exchange_n(&dev->n_full_flushes, 0,
+				__ATOMIC_RELAXED);
+		n_partial += __atomic_exchange_n(&dev->n_partial_flushes, 0,
+				__ATOMIC_RELAXED);
+		partial_bytes += __atomic_exchange_n(&dev->n_partial_bytes, 0,
+				__ATOMIC_RELAXED);
+	}
+
+	uint64_t full_bytes = n_full * g_scfg.large_block_ops_bytes;
+
+	printf("write-buffer-flushes: %" PRIu64 " full, %" PRIu64 " partial "
+			"averaging %.1lf KB, %.2lfx full-block bytes\n", n_full, n_partial,
+			n_partial == 0 ? 0.0 : (double)partial_bytes / n_partial / 1024,
+			full_bytes == 0 ?
+					0.0 : (double)(full_bytes + partial_bytes) / full_bytes);
+}
+
+//------------------------------------------------
+// Most threads that may report ops, so histograms
+// can give each its own shard.
+//
+static uint32_t
+max_reporting_threads()
+{
+	if (g_scfg.closed_loop_qd != 0) {
+		return g_scfg.num_devices * (g_scfg.io_engine != IO_ENGINE_SYNC ?
+				1 : g_scfg.closed_loop_qd);
+	}
+
+	// Large-block read and write threads, and service threads - rounding
+	// may give each NUMA group, at most one per device, one thread extra.
+	return (3 * g_scfg.num_devices) + g_scfg.service_threads;
+}
+
+//------------------------------------------------
+// Group devices by NUMA node for service threads.
+// Without numa-placement, there's just one group.
+// Groups get threads in proportion to their
+// devices, at least one each, and each group does
+// its devices' share of the requests.
+//
+static bool
+set_svc_groups()
+{
+	uint32_t total_reqs_per_sec =
+			g_scfg.internal_read_reqs_per_sec +
+			g_scfg.internal_write_reqs_per_sec;
+
+	uint64_t read_split = (uint64_t)SPLIT_RESOLUTION *
+			g_scfg.internal_read_reqs_per_sec / total_reqs_per_sec;
+
+	for (uint32_t d = 0; d < g_scfg.num_devices; d++) {
+		device* dev = &g_devices[d];
+		svc_group* group = NULL;
+
+		for (uint32_t g = 0; g < g_n_svc_groups; g++) {
+			if (g_svc_groups[g].numa_node == dev->numa_node) {
+				group = &g_svc_groups[g];
+				break;
+			}
+		}
+
+		if (group == NULL) {
+			group = &g_svc_groups[g_n_svc_groups++];
+			group->numa_node = dev->numa_node;
+			group->cpus = device_cpus(dev);
+			group->n_devices = 0;
+			group->read_split = read_split;
+		}
+
+		group->devices[group->n_devices++] = dev;
+		dev->svc_group = group;
+	}
+
+	if (g_scfg.service_threads < g_n_svc_groups) {
+		printf("ERROR: %" PRIu32 " service threads - need at least one per "
+				"NUMA node, %" PRIu32 "\n", g_scfg.service_threads,
+				g_n_svc_groups);
+		return false;
+	}
+
+	uint64_t n_devices = g_scfg.num_devices;
+
+	for (uint32_t g = 0; g < g_n_svc_groups; g++) {
+		svc_group* group = &g_svc_groups[g];
+
+		// Rounded to nearest.
+		uint32_t n_threads = (uint32_t)
+				(((2 * (uint64_t)g_scfg.service_threads * group->n_devices) +
+						n_devices) / (2 * n_devices));
+
+		group->n_threads = n_threads == 0 ? 1 : n_threads;
+		group->thread_reqs_per_sec = (double)total_reqs_per_sec *
+				group->n_devices / (double)n_devices / group->n_threads;
+
+		g_n_svc_threads += group->n_threads;
+
+		if (group->numa_node != -1) {
+			printf("NUMA node %d: %" PRIu32 " devices, %" PRIu32
+					" service threads\n", group->numa_node, group->n_devices,
+					group->n_threads);
+		}
+	}
+
+	return true;
+}
+
+//------------------------------------------------
+// Do one transaction write operation and report.
+//
+static void
+write_and_report(trans_req* write_req)
+{
+	// Each record gets freshly salted data.
+	const uint8_t* buf = payload_next(0, write_req->size);
+
+	uint64_t start_time = get_ns();
+	uint64_t stop_time = write_to_device(write_req->dev, write_req->offset,
+			write_req->size, buf);
+
+	if (stop_time != -1) {
+		report_op(OP_WRITE, write_req->dev, write_req->sched_ns, start_time,
+				stop_time, write_req->size);
+	}
+}
+
+//------------------------------------------------
+// Do one large block write operation and report.
+//
+static void
+write_and_report_large_block(device* dev, uint64_t sched_ns)
+{
+	// Each block gets freshly salted data.
+	const uint8_t* buf = payload_next(0, g_scfg.large_block_ops_bytes);
+
+	uint64_t offset = large_block_write_offset(dev);
+	uint64_t start_time = get_ns();
+	uint64_t stop_time = write_to_device(dev, offset,
+			g_scfg.large_block_ops_bytes, buf);
+
+	if (stop_time != -1) {
+		report_op(OP_LARGE_BLOCK_WRITE, dev, sched_ns, start_time, stop_time,
+				g_scfg.large_block_ops_bytes);
+	}
+}
+
+//------------------------------------------------
+// Do one device write operation.
+//
+static uint64_t
+write_to_device(device* dev, uint64_t offset, uint32_t size, const uint8_t* buf)
+{
+	int fd = fd_get(dev);
+
+	if (fd == -1) {
+		return -1;
+	}
+
+	count_hw_queue_submit(dev);
+
+	if (! pwrite_all(fd, buf, size, offset)) {
+		close(fd);
+		printf("ERROR: writing %s: %d '%s'\n", dev->name, errno,
+				act_strerror(errno));
+		return -1;
+	}
+
+	uint64_t stop_ns = get_ns();
+
+	fd_put(dev, fd);
+
+	return stop_ns;
+}
+
+
+//==========================================================
+// Local helpers - asynchronous io engines.
+//
+
+//------------------------------------------------
+// Set up a thread's io context, and 'depth' ops
+// with pooled aligned buffers of the specified
+// size. (Threads that only write can pass size 0,
+// write ops get their data from the payload ring.)
+//
+static bool
+async_thread_init(async_thread* at, uint32_t buf_size, uint32_t depth)
+{
+	at->depth = depth;
+	at->pool.mem = NULL;
+
+	if ((at->aio = async_io_create(g_scfg.io_engine, depth)) == NULL) {
+		return false;
+	}
+
+	at->ops = calloc(depth, sizeof(io_op));
+	at->free_ops = malloc(depth * sizeof(io_op*));
+
+	if (at->ops == NULL || at->free_ops == NULL) {
+		printf("ERROR: async thread ops (malloc)\n");
+		async_thread_destroy(at);
+		return false;
+	}
+
+	if (buf_size != 0 && ! buf_pool_init(&at->pool, depth, buf_size)) {
+		async_thread_destroy(at);
+		return false;
+	}
+
+	at->n_free = 0;
+
+	for (uint32_t i = 0; i < depth; i++) {
+		at->ops[i].slot = i;
+		at->free_ops[at->n_free++] = &at->ops[i];
+	}
+
+	return true;
+}
+
+//------------------------------------------------
+// Tear down a thread's io context and ops. All
+// ops must have been reaped.
+//
+static void
+async_thread_destroy(async_thread* at)
+{
+	buf_pool_free(&at->pool);
+	free(at->ops);
+	free(at->free_ops);
+	async_io_destroy(at->aio);
+}
+
+//------------------------------------------------
+// Largest transaction read or write on any device.
+//
+static uint32_t
+max_trans_bytes()
+{
+	uint32_t max_bytes = 0;
+
+	for (uint32_t d = 0; d < g_scfg.num_devices; d++) {
+		const device* dev = &g_devices[d];
+		uint32_t read_max = dev->read_bytes +
+				(dev->min_op_bytes * (dev->n_read_sizes - 1));
+		uint32_t write_max = dev->write_bytes +
+				(dev->min_commit_bytes * (dev->n_write_sizes - 1));
+
+		if (read_max > max_bytes) {
+			max_bytes = read_max;
+		}
+
+		if (g_scfg.commit_to_device && write_max > max_bytes) {
+			max_bytes = write_max;
+		}
+	}
+
+	return max_bytes;
+}
+
+static void
+prep_large_block_read(io_op* op, void* pv_dev)
+{
+	device* dev = (device*)pv_dev;
+
+	op->udata = (void*)dev;
+	op->tag = OP_LARGE_BLOCK_READ;
+	op->is_write = false;
+	op->offset = large_block_read_offset(dev);
+	op->size = g_scfg.large_block_ops_bytes;
+}
+
+static void
+prep_large_block_write(io_op* op, void* pv_dev)
+{
+	device* dev = (device*)pv_dev;
+
+	op->udata = (void*)dev;
+	op->tag = OP_LARGE_BLOCK_WRITE;
+	op->is_write = true;
+	op->offset = large_block_write_offset(dev);
+	op->size = g_scfg.large_block_ops_bytes;
+
+	// Each block gets freshly salted data.
+	op->buf = payload_next(op->slot, op->size);
+}
+
+static void
+prep_read(io_op* op, device* dev)
+{
+	op->udata = (void*)dev;
+	op->tag = OP_READ;
+	op->is_write = false;
+	op->offset = random_read_offset(dev);
+	op->size = random_read_size(dev);
+}
+
+static void
+prep_service_op(io_op* op, void* pv_group)
+{
+	const svc_group* group = (const svc_group*)pv_group;
+	uint32_t random_dev_index = rand_32() % group->n_devices;
+	device* random_dev = group->devices[random_dev_index];
+
+	if (group->read_split > rand_64() % SPLIT_RESOLUTION) {
+		prep_read(op, random_dev);
+	}
+	else {
+		prep_write(op, random_dev);
+	}
+}
+
+static void
+prep_write(io_op* op, device* dev)
+{
+	op->udata = (void*)dev;
+	op->tag = OP_WRITE;
+	op->is_write = true;
+	op->offset = random_write_offset(dev);
+	op->size = random_write_size(dev);
+
+	// Each record gets freshly salted data.
+	op->buf = payload_next(op->slot, op->size);
+}
+
+//------------------------------------------------
+// Collect completed ops, waiting up to timeout_us
+// for at least one, report them, and recycle them.
+//
+static void
+reap_and_report(async_thread* at, uint64_t timeout_us)
+{
+	io_op* done[at->depth];
+	uint32_t n_done = async_io_reap(at->aio, done, at->depth, timeout_us);
+	uint64_t stop_ns = get_ns();
+
+	for (uint32_t i = 0; i < n_done; i++) {
+		report_async_op(done[i], stop_ns);
+		at->free_ops[at->n_free++] = done[i];
+	}
+}
+
+//------------------------------------------------
+// Report one completed op - latency is measured
+// from submission to completion.
+//
+static void
+report_async_op(io_op* op, uint64_t stop_ns)
+{
+	device* dev = (device*)op->udata;
+
+	if (op->res != (int32_t)op->size) {
+		close(op->fd);
+
+		if (op->res < 0) {
+			printf("ERROR: %s %s: %d '%s'\n",
+					op->is_write ? "writing" : "reading", dev->name, -op->res,
+					act_strerror(-op->res));
+		}
+		else {
+			printf("ERROR: %s %s: %d of %u bytes\n",
+					op->is_write ? "writing" : "reading", dev->name, op->res,
+					op->size);
+		}
+
+		return;
+	}
+
+	fd_put(dev, op->fd);
+
+	report_op((op_type)op->tag, dev, op->sched_ns, op->start_ns, stop_ns,
+			op->size);
+}
+
+//------------------------------------------------
+// Issue ops at a constant rate, keeping up to
+// io-depth in flight, and waiting for completions
+// in between. Drains all ops in flight on exit.
+//
+static void
+run_async_paced(async_thread* at, double ops_per_sec, prep_fn prep,
+		void* udata, const char* what)
+{
+	pacer pc;
+
+	// Only client requests follow arrival-distribution.
+	pacer_init(&pc, g_run_start_us * 1000, ops_per_sec,
+			prep == prep_service_op ? g_scfg.arrival : ARRIVAL_UNIFORM);
+
+	while (g_running) {
+		uint64_t now_ns = get_ns();
+
+		bool submit_failed = false;
+
+		while (at->n_free != 0 && pacer_is_due(&pc, now_ns)) {
+			if (! submit_async_op(at, prep, udata, pacer_next(&pc))) {
+				submit_failed = true;
+				break;
+			}
+		}
+
+		// A failed submit is a hard error - the op would be silently lost.
+		if (submit_failed) {
+			printf("ERROR: %s can't submit - test stopped\n", what);
+			g_running = false;
+			break;
+		}
+
+		int64_t lag_ns = pacer_lag_ns(&pc, now_ns);
+
+		if (g_scfg.max_lag_usec != 0 &&
+				lag_ns > (int64_t)g_scfg.max_lag_usec * 1000) {
+			printf("ERROR: %s can't keep up\n", what);
+
+			if (prep == prep_service_op) {
+				printf("ACT can't do requested load - test stopped\n");
+				printf("try configuring more 'service-threads' or 'io-depth'\n");
+			}
+			else {
+				printf("drive(s) can't keep up - test stopped\n");
+			}
+
+			g_running = false;
+			break;
+		}
+
+		// Wait for completions, or until the next op is due.
+		reap_and_report(at, lag_ns < 0 ?
+				(uint64_t)(-lag_ns + 999) / 1000 : REAP_WAIT_US);
+	}
+
+	while (async_io_in_flight(at->aio) != 0) {
+		reap_and_report(at, REAP_WAIT_US);
+	}
+}
+
+//------------------------------------------------
+// Prepare and submit one op. If it can't be
+// submitted, it goes straight back on the free
+// list.
+//
+static bool
+submit_async_op(async_thread* at, prep_fn prep, void* udata,
+		uint64_t sched_ns)
+{
+	io_op* op = at->free_ops[--at->n_free];
+
+	// Writes replace the buffer with payload data.
+	if (at->pool.mem != NULL) {
+		op->buf = buf_pool_get(&at->pool, op->slot);
+	}
+
+	prep(op, udata);
+	op->sched_ns = sched_ns;
+
+	device* dev = (device*)op->udata;
+
+	// Served from RAM - the op is done without reaching the device.
+	if (op->tag == OP_READ && read_hits_cache(dev, op->offset, op->size)) {
+		at->free_ops[at->n_free++] = op;
+		return true;
+	}
+
+	if ((op->fd = fd_get(dev)) == -1) {
+		at->free_ops[at->n_free++] = op;
+		return false;
+	}
+
+	count_hw_queue_submit(dev);
+
+	if (! async_io_submit(at->aio, op)) {
+		fd_put(dev, op->fd);
+		at->free_ops[at->n_free++] = op;
+		return false;
+	}
+
+	return true;
+}
+
+
+//==========================================================
+// Local helpers - closed-loop mode.
+//
+
+//------------------------------------------------
+// Buffer size big enough for any closed-loop op.
+//
+static uint32_t
+closed_loop_buf_bytes()
+{
+	uint32_t trans_bytes = max_trans_bytes();
+
+	return trans_bytes > g_scfg.large_block_ops_bytes ?
+			trans_bytes : g_scfg.large_block_ops_bytes;
+}
+
+//------------------------------------------------
+// Do one op synchronously and report.
+//
+static void
+do_sync_op(io_op* op)
+{
+	device* dev = (device*)op->udata;
+	uint64_t start_ns = get_ns();
+	uint64_t stop_ns = op->is_write ?
+			write_to_device(dev, op->offset, op->size, op->buf) :
+			read_from_device(dev, op->offset, op->size, op->buf);
+
+	if (stop_ns != -1) {
+		report_op((op_type)op->tag, dev, start_ns, start_ns, stop_ns,
+				op->size);
+	}
+}
+
+//------------------------------------------------
+// Pick the next op on a device, in proportion to
+// the configured load's op mix.
+//
+static void
+prep_closed_loop_op(io_op* op, void* pv_dev)
+{
+	device* dev = (device*)pv_dev;
+	uint64_t split = rand_64() % SPLIT_RESOLUTION;
+
+	if (split < g_closed_loop_splits[0]) {
+		prep_read(op, dev);
+	}
+	else if (split < g_closed_loop_splits[1]) {
+		prep_write(op, dev);
+	}
+	else if (split < g_closed_loop_splits[2]) {
+		prep_large_block_read(op, pv_dev);
+	}
+	else {
+		prep_large_block_write(op, pv_dev);
+	}
+}
+
+//------------------------------------------------
+// Print achieved throughput since last report,
+// overall and per device.
+//
+static void
+report_throughput(uint64_t interval_us)
+{
+	double interval_sec = (double)interval_us / 1000000;
+	uint64_t n_ops[g_scfg.num_devices];
+	uint64_t n_bytes[g_scfg.num_devices];
+	uint64_t total_ops = 0;
+	uint64_t total_bytes = 0;
+
+	for (uint32_t d = 0; d < g_scfg.num_devices; d++) {
+		device* dev = &g_devices[d];
+
+		n_ops[d] = __atomic_exchange_n(&dev->n_ops, 0, __ATOMIC_RELAXED);
+		n_bytes[d] = __atomic_exchange_n(&dev->n_bytes, 0, __ATOMIC_RELAXED);
+
+		total_ops += n_ops[d];
+		total_bytes += n_bytes[d];
+	}
+
+	printf("throughput: %.1lf iops, %.2lf MB/s\n",
+			(double)total_ops / interval_sec,
+			(double)total_bytes / interval_sec / (1024 * 1024));
+
+	for (uint32_t d = 0; d < g_scfg.num_devices; d++) {
+		printf("%s-throughput: %.1lf iops, %.2lf MB/s\n", g_devices[d].name,
+				(double)n_ops[d] / interval_sec,
+				(double)n_bytes[d] / interval_sec / (1024 * 1024));
+	}
+}
+
+//------------------------------------------------
+// Derive closed-loop op mix from configured load.
+// The rates only serve as relative weights here.
+//
+static void
+set_closed_loop_splits()
+{
+	double weights[] = {
+			g_scfg.internal_read_reqs_per_sec,
+			g_scfg.internal_write_reqs_per_sec, // non-zero if commit-to-device
+			g_scfg.large_block_reads_per_sec,
+			g_scfg.large_block_writes_per_sec
+	};
+
+	double total = 0;
+
+	for (uint32_t i = 0; i < 4; i++) {
+		total += weights[i];
+	}
+
+	double cumulative = 0;
+
+	for (uint32_t i = 0; i < 3; i++) {
+		cumulative += weights[i];
+		g_closed_loop_splits[i] =
+				(uint64_t)(SPLIT_RESOLUTION * cumulative / total);
+	}
 }
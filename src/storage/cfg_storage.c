@@ -37,7 +37,8 @@
 #include <string.h>
 
 #include "common/cfg.h"
-#include "common/hardware.h"
+#include "common/hdr_histogram.h"
+#include "common/random.h"
 #include "common/trace.h"
 
 
@@ -51,6 +52,7 @@ static const char TAG_SERVICE_THREADS[]         = "service-threads";
 static const char TAG_TEST_DURATION_SEC[]       = "test-duration-sec";
 static const char TAG_REPORT_INTERVAL_SEC[]     = "report-interval-sec";
 static const char TAG_MICROSECOND_HISTOGRAMS[]  = "microsecond-histograms";
+static const char TAG_NANOSECOND_HISTOGRAMS[]   = "nanosecond-histograms";
 static const char TAG_READ_REQS_PER_SEC[]       = "read-reqs-per-sec";
 static const char TAG_WRITE_REQS_PER_SEC[]      = "write-reqs-per-sec";
 static const char TAG_RECORD_BYTES[]            = "record-bytes";
@@ -66,11 +68,40 @@ static const char TAG_COMMIT_TO_DEVICE[]        = "commit-to-device";
 static const char TAG_TOMB_RAIDER[]             = "tomb-raider";
 static const char TAG_TOMB_RAIDER_SLEEP_USEC[]  = "tomb-raider-sleep-usec";
 static const char TAG_MAX_LAG_SEC[]             = "max-lag-sec";
+static const char TAG_IO_ENGINE[]               = "io-engine";
+static const char TAG_IO_DEPTH[]                = "io-depth";
+static const char TAG_CLOSED_LOOP_QUEUE_DEPTH[] = "closed-loop-queue-depth";
+static const char TAG_CO_HISTOGRAMS[]           = "co-histograms";
+static const char TAG_HDR_SIGNIFICANT_DIGITS[]  = "hdr-significant-digits";
+static const char TAG_ARRIVAL_DISTRIBUTION[]    = "arrival-distribution";
+static const char TAG_READ_DISTRIBUTION[]       = "read-distribution";
+static const char TAG_READ_ZIPF_THETA[]         = "read-zipf-theta";
+static const char TAG_READ_HOT_OPS_PCT[]        = "read-hot-ops-pct";
+static const char TAG_READ_HOT_SPACE_PCT[]      = "read-hot-space-pct";
+static const char TAG_READ_EXP_MEAN_PCT[]       = "read-exp-mean-pct";
+static const char TAG_LOG_STRUCTURED_WRITES[]   = "log-structured-writes";
+static const char TAG_STATEFUL_DEFRAG[]         = "stateful-defrag";
+static const char TAG_LIVE_DATA_PCT[]           = "live-data-pct";
+static const char TAG_FLUSH_MAX_MS[]            = "flush-max-ms";
+static const char TAG_POST_WRITE_CACHE_MBYTES[] = "post-write-cache-mbytes";
+static const char TAG_NUMA_PLACEMENT[]          = "numa-placement";
+static const char TAG_SERVICE_CPUS[]            = "service-cpus";
+static const char TAG_LARGE_BLOCK_CPUS[]        = "large-block-cpus";
+static const char TAG_TOMB_RAIDER_CPUS[]        = "tomb-raider-cpus";
+static const char TAG_CLOSED_LOOP_CPUS[]        = "closed-loop-cpus";
+static const char TAG_REPORTER_CPUS[]           = "reporter-cpus";
+static const char TAG_SCHED_FIFO_PRIORITY[]     = "sched-fifo-priority";
+static const char TAG_HW_QUEUE_PLACEMENT[]      = "hw-queue-placement";
+static const char TAG_HW_QUEUE_STATS[]          = "hw-queue-stats";
+static const char TAG_INTERVAL_LOG_FILE[]       = "interval-log-file";
+static const char TAG_INTERVAL_LOG_FORMAT[]     = "interval-log-format";
 
 // As in Aerospike server.
 #define RBLOCK_SIZE 16
 #define WBLOCK_SIZE (8 * 1024 * 1024)
 
+#define MAX_IO_DEPTH 4096
+
 
 //==========================================================
 // Forward declarations.
@@ -93,7 +124,18 @@ storage_cfg g_scfg = {
 		.replication_factor = 1,
 		.defrag_lwm_pct = 50,
 		.compress_pct = 100,
-		.max_lag_usec = 1000000 * 10
+		.max_lag_usec = 1000000 * 10,
+		.io_engine = IO_ENGINE_SYNC,
+		.arrival = ARRIVAL_UNIFORM,
+		.read_dist = {
+				.type = OFFSET_DIST_UNIFORM,
+				.zipf_theta = 0.99,
+				.hot_ops_pct = 90,
+				.hot_space_pct = 10,
+				.exp_mean_pct = 10
+		},
+		.live_data_pct = 50,
+		.io_depth = 32
 };
 
 
@@ -168,6 +210,9 @@ storage_configure(int argc, char* argv[])
 		else if (strcmp(tag, TAG_MICROSECOND_HISTOGRAMS) == 0) {
 			g_scfg.us_histograms = parse_yes_no();
 		}
+		else if (strcmp(tag, TAG_NANOSECOND_HISTOGRAMS) == 0) {
+			g_scfg.ns_histograms = parse_yes_no();
+		}
 		else if (strcmp(tag, TAG_READ_REQS_PER_SEC) == 0) {
 			g_scfg.read_reqs_per_sec = parse_uint32();
 		}
@@ -213,6 +258,91 @@ storage_configure(int argc, char* argv[])
 		else if (strcmp(tag, TAG_MAX_LAG_SEC) == 0) {
 			g_scfg.max_lag_usec = (uint64_t)parse_uint32() * 1000000;
 		}
+		else if (strcmp(tag, TAG_IO_ENGINE) == 0) {
+			g_scfg.io_engine = parse_io_engine();
+		}
+		else if (strcmp(tag, TAG_IO_DEPTH) == 0) {
+			g_scfg.io_depth = parse_uint32();
+		}
+		else if (strcmp(tag, TAG_CLOSED_LOOP_QUEUE_DEPTH) == 0) {
+			g_scfg.closed_loop_qd = parse_uint32();
+		}
+		else if (strcmp(tag, TAG_CO_HISTOGRAMS) == 0) {
+			g_scfg.co_histograms = parse_yes_no();
+		}
+		else if (strcmp(tag, TAG_HDR_SIGNIFICANT_DIGITS) == 0) {
+			g_scfg.hdr_significant_digits = parse_uint32();
+		}
+		else if (strcmp(tag, TAG_ARRIVAL_DISTRIBUTION) == 0) {
+			g_scfg.arrival = parse_arrival_dist();
+		}
+		else if (strcmp(tag, TAG_READ_DISTRIBUTION) == 0) {
+			g_scfg.read_dist.type = parse_offset_dist_type();
+		}
+		else if (strcmp(tag, TAG_READ_ZIPF_THETA) == 0) {
+			g_scfg.read_dist.zipf_theta = parse_double();
+		}
+		else if (strcmp(tag, TAG_READ_HOT_OPS_PCT) == 0) {
+			g_scfg.read_dist.hot_ops_pct = parse_uint32();
+		}
+		else if (strcmp(tag, TAG_READ_HOT_SPACE_PCT) == 0) {
+			g_scfg.read_dist.hot_space_pct = parse_uint32();
+		}
+		else if (strcmp(tag, TAG_READ_EXP_MEAN_PCT) == 0) {
+			g_scfg.read_dist.exp_mean_pct = parse_double();
+		}
+		else if (strcmp(tag, TAG_LOG_STRUCTURED_WRITES) == 0) {
+			g_scfg.log_structured_writes = parse_yes_no();
+		}
+		else if (strcmp(tag, TAG_STATEFUL_DEFRAG) == 0) {
+			g_scfg.stateful_defrag = parse_yes_no();
+		}
+		else if (strcmp(tag, TAG_LIVE_DATA_PCT) == 0) {
+			g_scfg.live_data_pct = parse_uint32();
+		}
+		else if (strcmp(tag, TAG_FLUSH_MAX_MS) == 0) {
+			g_scfg.flush_max_ms = parse_uint32();
+		}
+		else if (strcmp(tag, TAG_POST_WRITE_CACHE_MBYTES) == 0) {
+			g_scfg.post_write_cache_bytes = (uint64_t)parse_uint32() << 20;
+		}
+		else if (strcmp(tag, TAG_NUMA_PLACEMENT) == 0) {
+			g_scfg.numa_placement = parse_yes_no();
+		}
+		else if (strcmp(tag, TAG_SERVICE_CPUS) == 0) {
+			parse_thread_cpus(&g_scfg.service_cpus);
+		}
+		else if (strcmp(tag, TAG_LARGE_BLOCK_CPUS) == 0) {
+			parse_thread_cpus(&g_scfg.large_block_cpus);
+		}
+		else if (strcmp(tag, TAG_TOMB_RAIDER_CPUS) == 0) {
+			parse_thread_cpus(&g_scfg.tomb_raider_cpus);
+		}
+		else if (strcmp(tag, TAG_CLOSED_LOOP_CPUS) == 0) {
+			parse_thread_cpus(&g_scfg.closed_loop_cpus);
+		}
+		else if (strcmp(tag, TAG_REPORTER_CPUS) == 0) {
+			parse_thread_cpus(&g_scfg.reporter_cpus);
+		}
+		else if (strcmp(tag, TAG_SCHED_FIFO_PRIORITY) == 0) {
+			g_scfg.sched_fifo_priority = parse_uint32();
+		}
+		else if (strcmp(tag, TAG_HW_QUEUE_PLACEMENT) == 0) {
+			g_scfg.hw_queue_placement = parse_yes_no();
+		}
+		else if (strcmp(tag, TAG_HW_QUEUE_STATS) == 0) {
+			g_scfg.hw_queue_stats = parse_yes_no();
+		}
+		else if (strcmp(tag, TAG_INTERVAL_LOG_FILE) == 0) {
+			if (! parse_file_name(g_scfg.interval_log_file,
+					sizeof(g_scfg.interval_log_file))) {
+				configuration_error(tag);
+				return false;
+			}
+		}
+		else if (strcmp(tag, TAG_INTERVAL_LOG_FORMAT) == 0) {
+			g_scfg.interval_log_format = parse_interval_log_format();
+		}
 		else {
 			printf("ERROR: ignoring unknown config item '%s'\n", tag);
 			return false;
@@ -243,8 +373,20 @@ check_configuration()
 		return false;
 	}
 
+	if (! check_thread_cpus(&g_scfg.service_cpus, TAG_SERVICE_CPUS) ||
+			! check_thread_cpus(&g_scfg.large_block_cpus,
+					TAG_LARGE_BLOCK_CPUS) ||
+			! check_thread_cpus(&g_scfg.tomb_raider_cpus,
+					TAG_TOMB_RAIDER_CPUS) ||
+			! check_thread_cpus(&g_scfg.closed_loop_cpus,
+					TAG_CLOSED_LOOP_CPUS) ||
+			! check_thread_cpus(&g_scfg.reporter_cpus, TAG_REPORTER_CPUS)) {
+		return false;
+	}
+
 	if (g_scfg.service_threads == 0 &&
-			(g_scfg.service_threads = 5 * num_cpus()) == 0) {
+			(g_scfg.service_threads =
+					default_service_threads(&g_scfg.service_cpus)) == 0) {
 		configuration_error(TAG_SERVICE_THREADS);
 		return false;
 	}
@@ -302,6 +444,106 @@ check_configuration()
 		return false;
 	}
 
+	if (g_scfg.us_histograms && g_scfg.ns_histograms) {
+		configuration_error(TAG_NANOSECOND_HISTOGRAMS);
+		return false;
+	}
+
+	if (g_scfg.io_engine == IO_ENGINE_INVALID) {
+		configuration_error(TAG_IO_ENGINE);
+		return false;
+	}
+
+	if (g_scfg.io_depth == 0 || g_scfg.io_depth > MAX_IO_DEPTH) {
+		configuration_error(TAG_IO_DEPTH);
+		return false;
+	}
+
+	if (g_scfg.closed_loop_qd > MAX_IO_DEPTH) {
+		configuration_error(TAG_CLOSED_LOOP_QUEUE_DEPTH);
+		return false;
+	}
+
+	// Closed-loop mode has no schedule to measure from.
+	if (g_scfg.co_histograms && g_scfg.closed_loop_qd != 0) {
+		configuration_error(TAG_CO_HISTOGRAMS);
+		return false;
+	}
+
+	if (g_scfg.hdr_significant_digits > MAX_HDR_SIGNIFICANT_DIGITS) {
+		configuration_error(TAG_HDR_SIGNIFICANT_DIGITS);
+		return false;
+	}
+
+	if (g_scfg.arrival == ARRIVAL_INVALID) {
+		configuration_error(TAG_ARRIVAL_DISTRIBUTION);
+		return false;
+	}
+
+	if (g_scfg.read_dist.type == OFFSET_DIST_INVALID) {
+		configuration_error(TAG_READ_DISTRIBUTION);
+		return false;
+	}
+
+	// Written so NAN fails.
+	if (! (g_scfg.read_dist.zipf_theta > 0 && g_scfg.read_dist.zipf_theta < 1)) {
+		configuration_error(TAG_READ_ZIPF_THETA);
+		return false;
+	}
+
+	if (g_scfg.read_dist.hot_ops_pct > 100) {
+		configuration_error(TAG_READ_HOT_OPS_PCT);
+		return false;
+	}
+
+	if (g_scfg.read_dist.hot_space_pct == 0 ||
+			g_scfg.read_dist.hot_space_pct > 100) {
+		configuration_error(TAG_READ_HOT_SPACE_PCT);
+		return false;
+	}
+
+	if (! (g_scfg.read_dist.exp_mean_pct > 0 &&
+			g_scfg.read_dist.exp_mean_pct <= 100)) {
+		configuration_error(TAG_READ_EXP_MEAN_PCT);
+		return false;
+	}
+
+	// Stateful defrag needs block state, and paced large-block writes of all
+	// client data.
+	if (g_scfg.stateful_defrag && (! g_scfg.log_structured_writes ||
+			g_scfg.commit_to_device || g_scfg.closed_loop_qd != 0)) {
+		configuration_error(TAG_STATEFUL_DEFRAG);
+		return false;
+	}
+
+	if (g_scfg.live_data_pct == 0 || g_scfg.live_data_pct > 90) {
+		configuration_error(TAG_LIVE_DATA_PCT);
+		return false;
+	}
+
+	// Write buffers are only modeled for paced large-block writes.
+	if (g_scfg.flush_max_ms != 0 &&
+			(g_scfg.commit_to_device || g_scfg.closed_loop_qd != 0)) {
+		configuration_error(TAG_FLUSH_MAX_MS);
+		return false;
+	}
+
+	// Closed-loop mode does every op it picks.
+	if (g_scfg.post_write_cache_bytes != 0 && g_scfg.closed_loop_qd != 0) {
+		configuration_error(TAG_POST_WRITE_CACHE_MBYTES);
+		return false;
+	}
+
+	if (g_scfg.sched_fifo_priority > MAX_FIFO_PRIORITY) {
+		configuration_error(TAG_SCHED_FIFO_PRIORITY);
+		return false;
+	}
+
+	if (g_scfg.interval_log_format == INTERVAL_LOG_INVALID) {
+		configuration_error(TAG_INTERVAL_LOG_FORMAT);
+		return false;
+	}
+
 	return true;
 }
 
@@ -329,13 +571,14 @@ derive_configuration()
 			round_up_to_rblock(g_scfg.record_bytes_rmx);
 
 	// Assumes linear probability distribution across size range.
-	uint32_t avg_record_stored_bytes =
+	g_scfg.avg_record_stored_bytes =
 			(g_scfg.record_stored_bytes + g_scfg.record_stored_bytes_rmx) / 2;
 
 	// "Original" means excluding write rate due to defrag.
 	double original_write_rate_in_large_blocks_per_sec =
 			(double)internal_write_reqs_per_sec /
-			(double)(g_scfg.large_block_ops_bytes / avg_record_stored_bytes);
+			(double)(g_scfg.large_block_ops_bytes /
+					g_scfg.avg_record_stored_bytes);
 
 	double defrag_write_amplification =
 			100.0 / (double)(100 - g_scfg.defrag_lwm_pct);
@@ -364,11 +607,28 @@ derive_configuration()
 		g_scfg.large_block_writes_per_sec = g_scfg.large_block_reads_per_sec;
 	}
 
+	// Defrag reads and writes happen as blocks empty - they aren't paced.
+	if (g_scfg.stateful_defrag) {
+		g_scfg.large_block_reads_per_sec = 0;
+		g_scfg.large_block_writes_per_sec =
+				original_write_rate_in_large_blocks_per_sec;
+	}
+
+	uint64_t post_write_cache_blocks =
+			g_scfg.post_write_cache_bytes / g_scfg.large_block_ops_bytes;
+
+	g_scfg.post_write_cache_blocks = post_write_cache_blocks > UINT32_MAX ?
+			UINT32_MAX : (uint32_t)post_write_cache_blocks;
+
 	// To simulate the new storage-engine memory where defrag reads from RAM.
 	if (g_scfg.no_defrag_reads) {
 		g_scfg.large_block_reads_per_sec = 0;
 	}
 
+	// Only threads that keep a schedule get real-time priority.
+	g_scfg.service_cpus.fifo_priority = g_scfg.sched_fifo_priority;
+	g_scfg.large_block_cpus.fifo_priority = g_scfg.sched_fifo_priority;
+
 	// Non-zero load must be enough to calculate service thread rates safely.
 	uint32_t total_reqs_per_sec =
 			g_scfg.internal_read_reqs_per_sec +
@@ -409,6 +669,8 @@ echo_configuration()
 			g_scfg.report_interval_us / 1000000);
 	printf("%s: %s\n", TAG_MICROSECOND_HISTOGRAMS,
 			g_scfg.us_histograms ? "yes" : "no");
+	printf("%s: %s\n", TAG_NANOSECOND_HISTOGRAMS,
+			g_scfg.ns_histograms ? "yes" : "no");
 	printf("%s: %" PRIu32 "\n", TAG_READ_REQS_PER_SEC,
 			g_scfg.read_reqs_per_sec);
 	printf("%s: %" PRIu32 "\n", TAG_WRITE_REQS_PER_SEC,
@@ -439,6 +701,64 @@ echo_configuration()
 			g_scfg.tomb_raider_sleep_us);
 	printf("%s: %" PRIu64 "\n", TAG_MAX_LAG_SEC,
 			g_scfg.max_lag_usec / 1000000);
+	printf("%s: %s\n", TAG_IO_ENGINE,
+			io_engine_name(g_scfg.io_engine));
+	printf("%s: %" PRIu32 "\n", TAG_IO_DEPTH,
+			g_scfg.io_depth);
+	printf("%s: %" PRIu32 "\n", TAG_CLOSED_LOOP_QUEUE_DEPTH,
+			g_scfg.closed_loop_qd);
+	printf("%s: %s\n", TAG_CO_HISTOGRAMS,
+			g_scfg.co_histograms ? "yes" : "no");
+	printf("%s: %" PRIu32 "\n", TAG_HDR_SIGNIFICANT_DIGITS,
+			g_scfg.hdr_significant_digits);
+	printf("%s: %s\n", TAG_ARRIVAL_DISTRIBUTION,
+			arrival_dist_name(g_scfg.arrival));
+	printf("%s: %s\n", TAG_READ_DISTRIBUTION,
+			offset_dist_type_name(g_scfg.read_dist.type));
+	printf("%s: %.3lf\n", TAG_READ_ZIPF_THETA,
+			g_scfg.read_dist.zipf_theta);
+	printf("%s: %" PRIu32 "\n", TAG_READ_HOT_OPS_PCT,
+			g_scfg.read_dist.hot_ops_pct);
+	printf("%s: %" PRIu32 "\n", TAG_READ_HOT_SPACE_PCT,
+			g_scfg.read_dist.hot_space_pct);
+	printf("%s: %.3lf\n", TAG_READ_EXP_MEAN_PCT,
+			g_scfg.read_dist.exp_mean_pct);
+	printf("%s: %s\n", TAG_LOG_STRUCTURED_WRITES,
+			g_scfg.log_structured_writes ? "yes" : "no");
+	printf("%s: %s\n", TAG_STATEFUL_DEFRAG,
+			g_scfg.stateful_defrag ? "yes" : "no");
+	printf("%s: %" PRIu32 "\n", TAG_LIVE_DATA_PCT,
+			g_scfg.live_data_pct);
+	printf("%s: %" PRIu32 "\n", TAG_FLUSH_MAX_MS,
+			g_scfg.flush_max_ms);
+	printf("%s: %" PRIu64 "\n", TAG_POST_WRITE_CACHE_MBYTES,
+			g_scfg.post_write_cache_bytes >> 20);
+	printf("%s: %s\n", TAG_NUMA_PLACEMENT,
+			g_scfg.numa_placement ? "yes" : "no");
+
+	char buf[1000];
+
+	printf("%s: %s\n", TAG_SERVICE_CPUS,
+			thread_cpus_string(&g_scfg.service_cpus, buf, sizeof(buf)));
+	printf("%s: %s\n", TAG_LARGE_BLOCK_CPUS,
+			thread_cpus_string(&g_scfg.large_block_cpus, buf, sizeof(buf)));
+	printf("%s: %s\n", TAG_TOMB_RAIDER_CPUS,
+			thread_cpus_string(&g_scfg.tomb_raider_cpus, buf, sizeof(buf)));
+	printf("%s: %s\n", TAG_CLOSED_LOOP_CPUS,
+			thread_cpus_string(&g_scfg.closed_loop_cpus, buf, sizeof(buf)));
+	printf("%s: %s\n", TAG_REPORTER_CPUS,
+			thread_cpus_string(&g_scfg.reporter_cpus, buf, sizeof(buf)));
+	printf("%s: %" PRIu32 "\n", TAG_SCHED_FIFO_PRIORITY,
+			g_scfg.sched_fifo_priority);
+	printf("%s: %s\n", TAG_HW_QUEUE_PLACEMENT,
+			g_scfg.hw_queue_placement ? "yes" : "no");
+	printf("%s: %s\n", TAG_HW_QUEUE_STATS,
+			g_scfg.hw_queue_stats ? "yes" : "no");
+	printf("%s: %s\n", TAG_INTERVAL_LOG_FILE,
+			g_scfg.interval_log_file[0] == '\0' ?
+					"none" : g_scfg.interval_log_file);
+	printf("%s: %s\n", TAG_INTERVAL_LOG_FORMAT,
+			interval_log_format_name(g_scfg.interval_log_format));
 
 	printf("\nDERIVED CONFIGURATION\n");
 
@@ -452,6 +772,9 @@ echo_configuration()
 			g_scfg.large_block_reads_per_sec);
 	printf("large-block-writes-per-sec: %.2lf\n",
 			g_scfg.large_block_writes_per_sec);
+	printf("post-write-cache-blocks: %" PRIu32 "\n",
+			g_scfg.post_write_cache_blocks);
+	printf("random-fill: %s\n", rand_fill_name());
 
 	printf("\n");
 }
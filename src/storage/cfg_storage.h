@@ -31,7 +31,12 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "common/async_io.h"
 #include "common/cfg.h"
+#include "common/interval_log.h"
+#include "common/offset_dist.h"
+#include "common/pacer.h"
+#include "common/thread_cfg.h"
 
 
 //==========================================================
@@ -48,6 +53,7 @@ typedef struct storage_cfg_s {
 	uint64_t run_us;                // converted from literal units in seconds
 	uint64_t report_interval_us;    // converted from literal units in seconds
 	bool us_histograms;
+	bool ns_histograms;
 	uint32_t read_reqs_per_sec;
 	uint32_t write_reqs_per_sec;
 	uint32_t record_bytes;
@@ -63,14 +69,39 @@ typedef struct storage_cfg_s {
 	bool tomb_raider;
 	uint32_t tomb_raider_sleep_us;
 	uint64_t max_lag_usec;          // converted from literal units in seconds
+	io_engine io_engine;
+	uint32_t io_depth;
+	uint32_t closed_loop_qd;        // 0 means open loop (normal rate-driven)
+	bool co_histograms;
+	uint32_t hdr_significant_digits; // 0 means no log-linear histograms
+	arrival_dist arrival;
+	offset_dist_cfg read_dist;      // where reads land
+	bool log_structured_writes;
+	bool stateful_defrag;
+	uint32_t live_data_pct;
+	uint32_t flush_max_ms;          // 0 means no write buffer model
+	uint64_t post_write_cache_bytes; // converted from literal units in Mbytes
+	bool numa_placement;
+	thread_cfg service_cpus;        // service threads
+	thread_cfg large_block_cpus;    // large-block and defrag threads
+	thread_cfg tomb_raider_cpus;
+	thread_cfg closed_loop_cpus;
+	thread_cfg reporter_cpus;       // main thread, after startup
+	uint32_t sched_fifo_priority;   // 0 means normal scheduling
+	bool hw_queue_placement;
+	bool hw_queue_stats;
+	char interval_log_file[MAX_FILE_NAME_SIZE]; // empty means no log
+	interval_log_format interval_log_format;
 
 	// Derived from literal configuration:
 	uint32_t record_stored_bytes;
 	uint32_t record_stored_bytes_rmx;
+	uint32_t avg_record_stored_bytes;
 	uint32_t internal_read_reqs_per_sec;
 	uint32_t internal_write_reqs_per_sec;
 	double large_block_reads_per_sec;
 	double large_block_writes_per_sec;
+	uint32_t post_write_cache_blocks; // per device
 } storage_cfg;
 
 
@@ -0,0 +1,394 @@
+/*
+ * wblocks.c
+ *
+ * Copyright (c) 2020 Aerospike, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "wblocks.h"
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/random.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+// Unless live data is tracked, defrag frees just enough blocks to keep this
+// much of the device free.
+#define MIN_FREE_PCT 5
+
+// Most tries to find an overwritten record's block, weighted by live bytes.
+#define MAX_PICKS 32
+
+#define NOT_USED UINT32_MAX
+
+// A device's one defrag thread holds at most one block that is neither used
+// nor free - with more blocks than that, there's always one to reclaim.
+#define MIN_BLOCKS 2
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static void drop_record(wblocks* wb, uint32_t record_bytes);
+static void mark_used(wblocks* wb, uint32_t id);
+static uint32_t pop_defrag(wblocks* wb);
+static void push_free(wblocks* wb, uint32_t id);
+static void release(wblocks* wb, uint32_t id);
+static uint32_t take_free(wblocks* wb);
+static void unmark_used(wblocks* wb, uint32_t id);
+
+
+//==========================================================
+// Public API.
+//
+
+//------------------------------------------------
+// Start with every block free, in device order.
+//
+bool
+wblocks_init(wblocks* wb, uint64_t n_blocks)
+{
+	memset(wb, 0, sizeof(wblocks));
+
+	if (n_blocks >= NOT_USED) {
+		printf("ERROR: %" PRIu64 " large blocks - too many for log-structured "
+				"writes\n", n_blocks);
+		return false;
+	}
+
+	if (n_blocks < MIN_BLOCKS) {
+		printf("ERROR: %" PRIu64 " large blocks - too few for log-structured "
+				"writes\n", n_blocks);
+		return false;
+	}
+
+	wb->n_blocks = (uint32_t)n_blocks;
+	wb->min_free = (uint32_t)(n_blocks * MIN_FREE_PCT / 100);
+
+	if (wb->min_free == 0) {
+		wb->min_free = 1;
+	}
+
+	if (pthread_mutex_init(&wb->lock, NULL) != 0) {
+		printf("ERROR: write block state (mutex init)\n");
+		return false;
+	}
+
+	size_t ids_size = n_blocks * sizeof(uint32_t);
+
+	if (! (wb->free_q = malloc(ids_size)) ||
+		! (wb->used = malloc(ids_size)) ||
+		! (wb->used_ix = malloc(ids_size))) {
+		printf("ERROR: write block state (malloc)\n");
+		wblocks_free(wb);
+		return false;
+	}
+
+	for (uint32_t id = 0; id < wb->n_blocks; id++) {
+		wb->free_q[id] = id;
+		wb->used_ix[id] = NOT_USED;
+	}
+
+	wb->n_free = wb->n_blocks;
+
+	return true;
+}
+
+//------------------------------------------------
+// Free write block state. Safe to call on state
+// whose init failed.
+//
+void
+wblocks_free(wblocks* wb)
+{
+	pthread_mutex_destroy(&wb->lock);
+
+	free(wb->free_q);
+	free(wb->used);
+	free(wb->used_ix);
+	free(wb->live);
+	free(wb->defrag_q);
+
+	wb->free_q = NULL;
+	wb->used = NULL;
+	wb->used_ix = NULL;
+	wb->live = NULL;
+	wb->defrag_q = NULL;
+}
+
+//------------------------------------------------
+// Track live bytes per block, for stateful defrag.
+// The device starts with live_data_pct of its
+// blocks full, as if just loaded, and the rest
+// free. Call right after wblocks_init().
+//
+bool
+wblocks_track_live(wblocks* wb, uint32_t block_bytes, uint32_t lwm_pct,
+		uint32_t live_data_pct)
+{
+	size_t ids_size = (size_t)wb->n_blocks * sizeof(uint32_t);
+
+	if (! (wb->live = malloc(ids_size)) ||
+		! (wb->defrag_q = malloc(ids_size))) {
+		printf("ERROR: write block live data state (malloc)\n");
+		return false;
+	}
+
+	wb->block_bytes = block_bytes;
+	wb->lwm_bytes = (uint32_t)((uint64_t)block_bytes * lwm_pct / 100);
+
+	uint32_t n_full = (uint32_t)((uint64_t)wb->n_blocks * live_data_pct / 100);
+
+	for (uint32_t i = 0; i < n_full; i++) {
+		take_free(wb);
+	}
+
+	return true;
+}
+
+//------------------------------------------------
+// Get the next block to write - the head of the
+// free list. If none are free, defrag hasn't kept
+// up, so reclaim a used block as it would have.
+// (There are at least MIN_BLOCKS, so if none are
+// free or queued, some are used.)
+//
+uint32_t
+wblocks_alloc(wblocks* wb)
+{
+	pthread_mutex_lock(&wb->lock);
+
+	if (wb->n_free == 0) {
+		release(wb, wb->n_defrag != 0 ?
+				pop_defrag(wb) : wb->used[rand_64() % wb->n_used]);
+	}
+
+	uint32_t id = take_free(wb);
+
+	pthread_mutex_unlock(&wb->lock);
+
+	return id;
+}
+
+//------------------------------------------------
+// Get a block for defrag to read - a random used
+// block, freed if the device is short of free
+// blocks. (If nothing is written yet, any block.)
+//
+uint32_t
+wblocks_defrag(wblocks* wb)
+{
+	pthread_mutex_lock(&wb->lock);
+
+	uint32_t id;
+
+	if (wb->n_used == 0) {
+		id = (uint32_t)(rand_64() % wb->n_blocks);
+	}
+	else {
+		id = wb->used[rand_64() % wb->n_used];
+
+		if (wb->n_free < wb->min_free) {
+			release(wb, id);
+		}
+	}
+
+	pthread_mutex_unlock(&wb->lock);
+
+	return id;
+}
+
+//------------------------------------------------
+// Records totalling n_bytes were written anew -
+// drop their old copies from the blocks holding
+// them, queueing blocks for defrag as they fall
+// below the low-water mark.
+//
+void
+wblocks_replace(wblocks* wb, uint32_t n_bytes, uint32_t record_bytes)
+{
+	pthread_mutex_lock(&wb->lock);
+
+	for (uint32_t done = 0; done < n_bytes && wb->n_used != 0;
+			done += record_bytes) {
+		drop_record(wb, record_bytes);
+	}
+
+	pthread_mutex_unlock(&wb->lock);
+}
+
+//------------------------------------------------
+// Take the block longest queued for defrag, and
+// the live bytes defrag must rewrite from it. The
+// block is neither used nor free until passed to
+// wblocks_defrag_done().
+//
+bool
+wblocks_defrag_pop(wblocks* wb, uint32_t* id, uint32_t* live_bytes)
+{
+	pthread_mutex_lock(&wb->lock);
+
+	if (wb->n_defrag == 0) {
+		pthread_mutex_unlock(&wb->lock);
+		return false;
+	}
+
+	*id = pop_defrag(wb);
+	*live_bytes = wb->live[*id];
+	unmark_used(wb, *id);
+
+	pthread_mutex_unlock(&wb->lock);
+
+	return true;
+}
+
+//------------------------------------------------
+// A popped block's live data is rewritten - free
+// the block.
+//
+void
+wblocks_defrag_done(wblocks* wb, uint32_t id)
+{
+	pthread_mutex_lock(&wb->lock);
+	push_free(wb, id);
+	pthread_mutex_unlock(&wb->lock);
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+static void
+drop_record(wblocks* wb, uint32_t record_bytes)
+{
+	uint32_t id;
+
+	// A random record is in a block with odds proportional to its live bytes.
+	for (uint32_t i = 0; i < MAX_PICKS; i++) {
+		id = wb->used[rand_64() % wb->n_used];
+
+		if (rand_64() % wb->block_bytes < wb->live[id]) {
+			break;
+		}
+	}
+
+	uint32_t old_live = wb->live[id];
+	uint32_t new_live = old_live > record_bytes ? old_live - record_bytes : 0;
+
+	wb->live[id] = new_live;
+
+	if (old_live >= wb->lwm_bytes && new_live < wb->lwm_bytes) {
+		uint32_t tail = wb->defrag_head + wb->n_defrag;
+
+		if (tail >= wb->n_blocks) {
+			tail -= wb->n_blocks;
+		}
+
+		wb->defrag_q[tail] = id;
+		wb->n_defrag++;
+	}
+}
+
+static void
+mark_used(wblocks* wb, uint32_t id)
+{
+	wb->used_ix[id] = wb->n_used;
+	wb->used[wb->n_used++] = id;
+
+	if (wb->live != NULL) {
+		wb->live[id] = wb->block_bytes;
+	}
+}
+
+static uint32_t
+pop_defrag(wblocks* wb)
+{
+	uint32_t id = wb->defrag_q[wb->defrag_head];
+
+	if (++wb->defrag_head == wb->n_blocks) {
+		wb->defrag_head = 0;
+	}
+
+	wb->n_defrag--;
+
+	return id;
+}
+
+static void
+push_free(wblocks* wb, uint32_t id)
+{
+	uint32_t tail = wb->free_head + wb->n_free;
+
+	if (tail >= wb->n_blocks) {
+		tail -= wb->n_blocks;
+	}
+
+	wb->free_q[tail] = id;
+	wb->n_free++;
+}
+
+static void
+release(wblocks* wb, uint32_t id)
+{
+	unmark_used(wb, id);
+	push_free(wb, id);
+}
+
+static uint32_t
+take_free(wblocks* wb)
+{
+	uint32_t id = wb->free_q[wb->free_head];
+
+	if (++wb->free_head == wb->n_blocks) {
+		wb->free_head = 0;
+	}
+
+	wb->n_free--;
+	mark_used(wb, id);
+
+	return id;
+}
+
+static void
+unmark_used(wblocks* wb, uint32_t id)
+{
+	uint32_t ix = wb->used_ix[id];
+	uint32_t last_id = wb->used[--wb->n_used];
+
+	wb->used[ix] = last_id;
+	wb->used_ix[last_id] = ix;
+	wb->used_ix[id] = NOT_USED;
+}
@@ -0,0 +1,77 @@
+/*
+ * wblocks.h
+ *
+ * Copyright (c) 2020 Aerospike, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+// A device's write blocks, for log-structured large-block writes. As in the
+// server, writes take blocks from the head of a free list, and blocks emptied
+// by defrag go on its tail - so a fresh device is written front to back, and
+// after that blocks are reused in the order they were freed.
+typedef struct wblocks_s {
+	pthread_mutex_t lock;
+	uint32_t n_blocks;
+	uint32_t min_free;      // defrag frees blocks only below this many free
+	uint32_t* free_q;       // ring of free block ids, in allocation order
+	uint32_t free_head;
+	uint32_t n_free;
+	uint32_t* used;         // ids of used blocks, in no particular order
+	uint32_t* used_ix;      // each block's index in 'used', if used
+	uint32_t n_used;
+
+	// If tracking live data, for stateful defrag:
+	uint32_t* live;         // each used block's live bytes
+	uint32_t block_bytes;
+	uint32_t lwm_bytes;     // blocks falling below this are queued for defrag
+	uint32_t* defrag_q;     // ring of block ids, in the order queued
+	uint32_t defrag_head;
+	uint32_t n_defrag;
+} wblocks;
+
+
+//==========================================================
+// Public API.
+//
+
+bool wblocks_init(wblocks* wb, uint64_t n_blocks);
+void wblocks_free(wblocks* wb);
+bool wblocks_track_live(wblocks* wb, uint32_t block_bytes, uint32_t lwm_pct,
+		uint32_t live_data_pct);
+uint32_t wblocks_alloc(wblocks* wb);
+uint32_t wblocks_defrag(wblocks* wb);
+void wblocks_replace(wblocks* wb, uint32_t n_bytes, uint32_t record_bytes);
+bool wblocks_defrag_pop(wblocks* wb, uint32_t* id, uint32_t* live_bytes);
+void wblocks_defrag_done(wblocks* wb, uint32_t id);